@@ -36,6 +36,8 @@
 Adafruit_FRAM_I2C::Adafruit_FRAM_I2C(void)
 {
   _framInitialised = false;
+  _chipCount = 0;
+  _totalSize = 0;
 }
 
 /*========================================================================*/
@@ -46,79 +48,144 @@ Adafruit_FRAM_I2C::Adafruit_FRAM_I2C(void)
 /*!
     Initializes I2C and configures the chip (call this function before
     doing anything else)
+
+    Chips answering at addr and the addresses after it are sized from
+    their device ID (density nibble - capacity is 1 << (density + 10)) and
+    presented as one linear address space. Parts over 64KB, such as the
+    MB85RC1M, take address bit 16 and up in the I2C address so they use
+    more than one slot. A part with no device ID is taken to be
+    MB85RC_FALLBACK_SIZE bytes.
 */
 /**************************************************************************/
 boolean Adafruit_FRAM_I2C::begin(uint8_t addr)
 {
   i2c_addr = addr;
+  Wire.setSpeed(CLOCK_SPEED_400KHZ);        // MB85RC parts run at up to 1MHz - speeds up burst reads for dumps
   Wire.begin();
 
-  /* Make sure we're actually connected */
-  /* Taking this check out as I move to the 64kb chip
-  uint16_t manufID, prodID;
-  getDeviceID(&manufID, &prodID);
-  if (manufID != 0x00A)
-  {
-    //Serial.print("Unexpected Manufacturer ID: 0x");
-    //Serial.println(manufID, HEX);
-    return false;
-  }
-  if (prodID != 0x510)
-  {
-    //Serial.print("Unexpected Product ID: 0x");
-    //Serial.println(prodID, HEX);
-    return false;
+  _chipCount = 0;
+  _totalSize = 0;
+  while (addr < MB85RC_DEFAULT_ADDRESS + MB85RC_MAX_CHIPS && _chipCount < MB85RC_MAX_CHIPS) {
+    Wire.beginTransmission(addr);
+    if (Wire.endTransmission() != 0) break;     /* Chips have to be at consecutive addresses */
+
+    uint16_t manufID, prodID;
+    uint32_t chipSize = MB85RC_FALLBACK_SIZE;
+    if (readDeviceID(addr, &manufID, &prodID) && manufID == 0x00A) {
+      chipSize = 1UL << (((prodID >> 8) & 0x0F) + 10);
+    }
+    _chip[_chipCount].i2cAddr = addr;
+    _chip[_chipCount].size = chipSize;
+    _chipCount++;
+    _totalSize += chipSize;
+    addr += (chipSize > 0x10000) ? chipSize >> 16 : 1;
   }
-  */
+
   /* Everything seems to be properly initialised and connected */
-  _framInitialised = true;
+  _framInitialised = _chipCount > 0;
 
-  return true;
+  return _framInitialised;
 }
 
 /**************************************************************************/
 /*!
     @brief  Writes a uint8_t at the specific FRAM address
 
-    @params[in] i2cAddr
-                The I2C address of the FRAM memory chip (1010+A2+A1+A0)
     @params[in] framAddr
-                The 16-bit address to write to in FRAM memory
-    @params[in] i2cAddr
+                The address to write to in the combined FRAM space
+    @params[in] value
                 The 8-bit value to write at framAddr
 */
 /**************************************************************************/
-void Adafruit_FRAM_I2C::write8 (uint16_t framAddr, uint8_t value)
+void Adafruit_FRAM_I2C::write8 (uint32_t framAddr, uint8_t value)
 {
-  Wire.beginTransmission(i2c_addr);
-  Wire.write(framAddr >> 8);
-  Wire.write(framAddr & 0xFF);
-  Wire.write(value);
-  Wire.endTransmission();
+  write(framAddr, &value, 1);
 }
 
 /**************************************************************************/
 /*!
     @brief  Reads an 8 bit value from the specified FRAM address
 
-    @params[in] i2cAddr
-                The I2C address of the FRAM memory chip (1010+A2+A1+A0)
     @params[in] framAddr
-                The 16-bit address to read from in FRAM memory
+                The address to read from in the combined FRAM space
 
     @returns    The 8-bit value retrieved at framAddr
 */
 /**************************************************************************/
-uint8_t Adafruit_FRAM_I2C::read8 (uint16_t framAddr)
+uint8_t Adafruit_FRAM_I2C::read8 (uint32_t framAddr)
+{
+  uint8_t value = 0;
+  read(framAddr, &value, 1);
+  return value;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Writes a block of bytes starting at the specified FRAM address
+
+    The FRAM auto-increments its address pointer so each chunk is a single
+    I2C transaction - chunks are sized to fit the Wire buffer and split
+    where the block crosses into the next chip or 64KB page.
+
+    @params[in] framAddr
+                The address of the first byte to write
+    @params[in] values
+                The bytes to write
+    @params[in] count
+                The number of bytes to write
+*/
+/**************************************************************************/
+void Adafruit_FRAM_I2C::write (uint32_t framAddr, const uint8_t *values, size_t count)
 {
-  Wire.beginTransmission(i2c_addr);
-  Wire.write(framAddr >> 8);
-  Wire.write(framAddr & 0xFF);
-  Wire.endTransmission();
+  while (count > 0) {
+    uint8_t device;
+    uint16_t wordAddr;
+    size_t chunk = min(min(count, locate(framAddr, &device, &wordAddr)), (size_t)(MB85RC_WIRE_BUFFER - 2));
+    if (!chunk) return;                           /* Past the end of the FRAM */
+    Wire.beginTransmission(device);
+    Wire.write(wordAddr >> 8);
+    Wire.write(wordAddr & 0xFF);
+    Wire.write(values, chunk);
+    Wire.endTransmission();
+    framAddr += chunk;
+    values += chunk;
+    count -= chunk;
+  }
+}
 
-  Wire.requestFrom(i2c_addr, (uint8_t)1);
+/**************************************************************************/
+/*!
+    @brief  Reads a block of bytes starting at the specified FRAM address
+
+    @params[in] framAddr
+                The address of the first byte to read
+    @params[out] values
+                Where to put the bytes that were read
+    @params[in] count
+                The number of bytes to read
+*/
+/**************************************************************************/
+void Adafruit_FRAM_I2C::read (uint32_t framAddr, uint8_t *values, size_t count)
+{
+  while (count > 0) {
+    uint8_t device;
+    uint16_t wordAddr;
+    size_t chunk = min(min(count, locate(framAddr, &device, &wordAddr)), (size_t)MB85RC_WIRE_BUFFER);
+    if (!chunk) {                                 /* Past the end of the FRAM */
+      memset(values, 0, count);
+      return;
+    }
+    Wire.beginTransmission(device);
+    Wire.write(wordAddr >> 8);
+    Wire.write(wordAddr & 0xFF);
+    Wire.endTransmission();
 
-  return Wire.read();
+    Wire.requestFrom(device, (uint8_t)chunk);
+    for (size_t i = 0; i < chunk; i++) values[i] = Wire.read();
+    framAddr += chunk;
+    values += chunk;
+    count -= chunk;
+  }
 }
 
 /**************************************************************************/
@@ -134,15 +201,29 @@ uint8_t Adafruit_FRAM_I2C::read8 (uint16_t framAddr)
 */
 /**************************************************************************/
 void Adafruit_FRAM_I2C::getDeviceID(uint16_t *manufacturerID, uint16_t *productID)
+{
+  readDeviceID(i2c_addr, manufacturerID, productID);
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+/**************************************************************************/
+/*!
+    @brief  Reads the device ID of the chip at addr - false if it did not
+            answer the device ID command
+*/
+/**************************************************************************/
+boolean Adafruit_FRAM_I2C::readDeviceID(uint8_t addr, uint16_t *manufacturerID, uint16_t *productID)
 {
   uint8_t a[3] = { 0, 0, 0 };
-  uint8_t results;
 
   Wire.beginTransmission(MB85RC_SLAVE_ID >> 1);
-  Wire.write(i2c_addr << 1);
-  results = Wire.endTransmission(false);
+  Wire.write(addr << 1);
+  uint8_t results = Wire.endTransmission(false);
 
-  Wire.requestFrom(MB85RC_SLAVE_ID >> 1, 3);
+  uint8_t received = Wire.requestFrom(MB85RC_SLAVE_ID >> 1, 3);
   a[0] = Wire.read();
   a[1] = Wire.read();
   a[2] = Wire.read();
@@ -151,4 +232,33 @@ void Adafruit_FRAM_I2C::getDeviceID(uint16_t *manufacturerID, uint16_t *productI
   /* See p.10 of http://www.fujitsu.com/downloads/MICRO/fsa/pdf/products/memory/fram/MB85RC256V-DS501-00017-3v0-E.pdf */
   *manufacturerID = (a[0] << 4) + (a[1]  >> 4);
   *productID = ((a[1] & 0x0F) << 8) + a[2];
+  return results == 0 && received == 3;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Finds the chip holding framAddr
+
+    @params[in]  framAddr
+                 The address in the combined FRAM space
+    @params[out] device
+                 I2C address to use - includes address bits 16 and up
+    @params[out] wordAddr
+                 The 16-bit address to send to the chip
+
+    @returns     Bytes from framAddr to the end of the chip or 64KB page,
+                 0 if framAddr is past the end of the FRAM
+*/
+/**************************************************************************/
+size_t Adafruit_FRAM_I2C::locate(uint32_t framAddr, uint8_t *device, uint16_t *wordAddr)
+{
+  for (uint8_t i = 0; i < _chipCount; i++) {
+    if (framAddr < _chip[i].size) {
+      *device = _chip[i].i2cAddr + (framAddr >> 16);
+      *wordAddr = framAddr & 0xFFFF;
+      return min(_chip[i].size - framAddr, 0x10000 - (framAddr & 0xFFFF));
+    }
+    framAddr -= _chip[i].size;
+  }
+  return 0;
 }
@@ -40,19 +40,36 @@
 
 #define MB85RC_DEFAULT_ADDRESS        (0x50) /* 1010 + A2 + A1 + A0 = 0x50 default */
 #define MB85RC_SLAVE_ID       (0xF8)
+#define MB85RC_WIRE_BUFFER    (32)   /* Particle Wire buffer - includes the two address bytes on writes */
+#define MB85RC_MAX_CHIPS      (8)    /* 0x50 - 0x57 */
+#define MB85RC_FALLBACK_SIZE  (32768) /* Size assumed for a part with no device ID - the MB85RC256V */
 
 class Adafruit_FRAM_I2C {
  public:
   Adafruit_FRAM_I2C(void);
 
   boolean  begin(uint8_t addr = MB85RC_DEFAULT_ADDRESS);
-  void     write8 (uint16_t framAddr, uint8_t value);
-  uint8_t  read8  (uint16_t framAddr);
+  void     write8 (uint32_t framAddr, uint8_t value);
+  uint8_t  read8  (uint32_t framAddr);
+  void     write  (uint32_t framAddr, const uint8_t *values, size_t count);
+  void     read   (uint32_t framAddr, uint8_t *values, size_t count);
   void     getDeviceID(uint16_t *manufacturerID, uint16_t *productID);
+  uint32_t size(void) { return _totalSize; }
+  uint8_t  chips(void) { return _chipCount; }
 
  private:
+  struct Chip {
+    uint8_t  i2cAddr;
+    uint32_t size;
+  };
+  boolean  readDeviceID(uint8_t addr, uint16_t *manufacturerID, uint16_t *productID);
+  size_t   locate(uint32_t framAddr, uint8_t *device, uint16_t *wordAddr);
+
   uint8_t i2c_addr;
   boolean _framInitialised;
+  Chip     _chip[MB85RC_MAX_CHIPS];
+  uint8_t  _chipCount;
+  uint32_t _totalSize;
 };
 
 #endif
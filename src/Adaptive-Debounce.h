@@ -0,0 +1,149 @@
+// Adaptive Debounce Header File
+// Learns the rejection window for a site from the pulses its tube produces. The sensor interrupt times every edge:
+// pulse widths (rise to fall) and the gaps between rising edges go into two log scale histograms. Gaps fall into two
+// groups - bounce and the axles of one vehicle are close together, separate vehicles are further apart - so the
+// window is put in the valley between them (split found with Otsu's method). It is never shorter than nearly all
+// pulse widths. The histograms are kept in FRAM and halved as they fill so the window follows changes at the site.
+
+const int debounceBuckets = 24;
+const uint16_t debounceEdges[debounceBuckets] = {0, 26, 34, 44, 57, 74, 97, 125, 163, 212, 276, 358, 466, 606,
+    788, 1024, 1331, 1730, 2249, 2924, 3801, 4941, 6424, 8351};   // Lower edge of each bucket in mSec - steps of 1.3x
+const unsigned long debounceMinSamples = 100;       // Gaps needed before the histogram is trusted
+const unsigned long debounceDecaySamples = 4000;    // Halve the histograms past this so old traffic fades
+const int debounceMinConfidence = 60;               // Percent needed before auto mode uses the learned window
+const int debounceMinMs = 100;                      // The one range for Set-Debounce, the Config debounce key, setup() and learning
+const int debounceMaxMs = 2000;
+
+struct DebounceHistograms {                         // 96 bytes in FRAM
+    uint16_t width[debounceBuckets];                // Pulse widths
+    uint16_t gap[debounceBuckets];                  // Rising edge to rising edge
+};
+
+volatile DebounceHistograms pulseStats;             // Written by the sensor interrupt
+volatile unsigned long lastRiseMillis = 0;
+volatile bool edgeTimingValid = false;              // False until we have seen a rising edge since start-up or the last nap
+bool debounceAuto = false;                          // Manual (Set-Debounce value) unless switched to auto
+int learnedDebounce = 0;                            // mSec - 0 until learned
+int debounceConfidence = 0;                         // Percent
+
+int debounceBucket(unsigned long ms)
+{
+    int i = debounceBuckets - 1;
+    while (i > 0 && ms < debounceEdges[i]) i--;
+    return i;
+}
+
+void debounceEdge(bool rising)                      // Called from the sensor interrupt on both edges
+{
+    unsigned long now = millis();
+    if (rising) {
+        if (edgeTimingValid) {
+            volatile uint16_t &bucket = pulseStats.gap[debounceBucket(now - lastRiseMillis)];
+            if (bucket < 0xFFFF) bucket++;
+        }
+        lastRiseMillis = now;
+        edgeTimingValid = true;
+    }
+    else if (edgeTimingValid) {
+        volatile uint16_t &bucket = pulseStats.width[debounceBucket(now - lastRiseMillis)];
+        if (bucket < 0xFFFF) bucket++;
+    }
+}
+
+void debounceNapped()                               // millis() stops in stop mode - edges either side of a nap can't be timed
+{
+    edgeTimingValid = false;
+}
+
+void debounceBegin()                                // Load the learned window and histograms from FRAM
+{
+    DebounceHistograms saved;
+    debounceAuto = FRAMread8(FRAM::debounceAutoAddr) == 1;
+    learnedDebounce = FRAMread16(FRAM::learnedDebounceAddr);
+    debounceConfidence = FRAMread8(FRAM::debounceConfidenceAddr);
+    if (learnedDebounce < debounceMinMs || learnedDebounce > debounceMaxMs || debounceConfidence > 100) {
+        learnedDebounce = 0;
+        debounceConfidence = 0;
+    }
+    FRAMreadBlock(FRAM::pulseHistogramsAddr, reinterpret_cast<uint8_t *>(&saved), sizeof(saved));
+    noInterrupts();
+    memcpy((void *)&pulseStats, &saved, sizeof(saved));
+    interrupts();
+}
+
+void debounceLearn()                                // Hourly - recompute the window and save the histograms
+{
+    DebounceHistograms stats;
+    noInterrupts();
+    memcpy(&stats, (const void *)&pulseStats, sizeof(stats));
+    interrupts();
+
+    unsigned long total = 0, widths = 0;
+    float sum = 0;
+    for (int i = 0; i < debounceBuckets; i++) {
+        total += stats.gap[i];
+        widths += stats.width[i];
+        sum += (float)i * stats.gap[i];
+    }
+
+    if (total >= 2) {
+        // Otsu - the split that best separates the two groups of gaps
+        int split = 0;
+        float best = -1, lowerCount = 0, lowerSum = 0;
+        for (int t = 0; t < debounceBuckets - 1; t++) {
+            lowerCount += stats.gap[t];
+            lowerSum += (float)t * stats.gap[t];
+            float upperCount = total - lowerCount;
+            if (lowerCount == 0 || upperCount == 0) continue;
+            float difference = lowerSum / lowerCount - (sum - lowerSum) / upperCount;
+            float between = lowerCount * upperCount * difference * difference;
+            if (between > best) {
+                best = between;
+                split = t;
+            }
+        }
+        // The window goes in the emptiest bucket between the two peaks - how empty it is gives the confidence
+        int lowerPeak = 0, upperPeak = split + 1;
+        for (int i = 0; i <= split; i++) if (stats.gap[i] > stats.gap[lowerPeak]) lowerPeak = i;
+        for (int i = split + 1; i < debounceBuckets; i++) if (stats.gap[i] > stats.gap[upperPeak]) upperPeak = i;
+        int valley = lowerPeak, valleyEnd = lowerPeak;
+        for (int i = lowerPeak; i < upperPeak; i++) {
+            if (stats.gap[i] < stats.gap[valley]) valley = valleyEnd = i;
+            else if (stats.gap[i] == stats.gap[valley]) valleyEnd = i;
+        }
+        valley = (valley + valleyEnd) / 2;          // Middle of a run of equally empty buckets
+        float smallerPeak = min(stats.gap[lowerPeak], stats.gap[upperPeak]);
+        float depth = smallerPeak > 0 ? (smallerPeak - stats.gap[valley]) / smallerPeak : 0;
+        float weight = min(1.0f, (float)total / debounceMinSamples);
+        int window = debounceEdges[valley + 1];
+
+        unsigned long seen = 0;                     // A pulse must not outlast the window - use the 90th percentile width
+        for (int i = 0; i < debounceBuckets && widths; i++) {
+            seen += stats.width[i];
+            if (seen * 10 >= widths * 9) {
+                if (i + 1 < debounceBuckets) window = max(window, (int)debounceEdges[i + 1]);
+                break;
+            }
+        }
+        learnedDebounce = constrain(window, debounceMinMs, debounceMaxMs);
+        debounceConfidence = int(depth * weight * 100);
+    }
+
+    if (total > debounceDecaySamples) {             // Halve so recent traffic counts for more
+        noInterrupts();
+        for (int i = 0; i < debounceBuckets; i++) {
+            pulseStats.gap[i] >>= 1;
+            pulseStats.width[i] >>= 1;
+        }
+        memcpy(&stats, (const void *)&pulseStats, sizeof(stats));
+        interrupts();
+    }
+    FRAMwrite16(FRAM::learnedDebounceAddr, learnedDebounce);
+    FRAMwrite8(FRAM::debounceConfidenceAddr, debounceConfidence);
+    FRAMwriteBlock(FRAM::pulseHistogramsAddr, reinterpret_cast<const uint8_t *>(&stats), sizeof(stats));
+}
+
+bool debounceLearnedReady()                         // True if auto mode should use the learned window
+{
+    return debounceAuto && learnedDebounce && debounceConfidence >= debounceMinConfidence;
+}
@@ -0,0 +1,97 @@
+// Burst Detector Header File
+// Decides when a minute has too many counts to be traffic. For each hour of the day it keeps an exponentially
+// weighted mean and variance of the counts in the minutes that had traffic - a few bytes per hour, updated as each
+// minute closes - so a busy hour at this site is judged against that hour and not against one fixed limit. A minute
+// is suspect once its count passes the mean plus a few standard deviations. Suspect counts are set aside by the
+// sketch rather than deleted, and the minute goes into the baseline clipped to the threshold so a fault can't teach
+// the detector that faults are normal. Until an hour has enough minutes behind it maxMinLimit is used as before.
+
+const int burstWarmupMinutes = 30;                  // Minutes with traffic before an hour's baseline is trusted
+const int burstShift = 4;                           // Weight of each new minute is 1/16
+const int burstDeviations = 4;                      // How far past the mean a minute has to be
+const int burstSlack = 2;                           // Extra counts allowed - keeps a steady hour from tripping on one more car
+
+struct __attribute__((packed)) BurstBucket {        // 5 bytes in FRAM for each hour of the day
+    uint16_t mean;                                  // Counts in a minute x 64
+    uint16_t variance;                              // x 16
+    uint8_t minutes;                                // Minutes learned - stops at 255
+};
+
+enum BurstVerdict { BURST_OK, BURST_TRIPPED, BURST_SUSPECT };
+
+BurstBucket burstBuckets[24];
+time_t burstMinuteStart = 0;                        // The minute being counted
+int burstMinuteCount = 0;                           // Counts in it so far - the suspect ones too
+bool burstMinuteSuspect = false;
+int burstThreshold = 0;                             // Most counts the minute can have - worked out when it starts
+
+void burstSave(int hour)
+{
+    FRAMwriteBlock(FRAM::burstBucketsAddr + hour * sizeof(BurstBucket), reinterpret_cast<const uint8_t *>(&burstBuckets[hour]), sizeof(BurstBucket));
+}
+
+void burstBegin()
+{
+    FRAMreadBlock(FRAM::burstBucketsAddr, reinterpret_cast<uint8_t *>(burstBuckets), sizeof(burstBuckets));
+}
+
+unsigned long burstRoot(unsigned long value)        // Integer square root
+{
+    unsigned long root = 0, bit = 1UL << 30;
+    while (bit > value) bit >>= 2;
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else root >>= 1;
+        bit >>= 2;
+    }
+    return root;
+}
+
+int burstLimit(int hour, int fallback)              // Most counts a minute in this hour can have before it is suspect
+{
+    const BurstBucket &bucket = burstBuckets[hour];
+    if (bucket.minutes < burstWarmupMinutes) return fallback - 1;   // Not learned yet - maxMinLimit trips as it always has
+    unsigned long limit = bucket.mean + burstDeviations * burstRoot(bucket.variance) * 16 + burstSlack * 64;   // x 64 - the root is x 4
+    return limit / 64;
+}
+
+void burstLearn(int hour, int count)                // A minute with traffic has closed
+{
+    BurstBucket &bucket = burstBuckets[hour];
+    count = min(count, 255);
+    long value = count * 64L;
+    if (!bucket.minutes) {                          // First minute - assume the spread is as big as the count
+        bucket.mean = min(value, 0xFFFFL);
+        bucket.variance = min(count * count * 16L, 0xFFFFL);
+    }
+    else {
+        long difference = value - bucket.mean;
+        bucket.mean = constrain(bucket.mean + difference / (1 << burstShift), 0L, 0xFFFFL);
+        unsigned long spread = bucket.variance + (unsigned long)(difference * difference / 256) / (1 << burstShift);
+        bucket.variance = min(spread - spread / (1 << burstShift), 0xFFFFUL);
+    }
+    if (bucket.minutes < 255) bucket.minutes++;
+    burstSave(hour);
+}
+
+BurstVerdict burstCount(time_t now, int fallback)   // Adds a count to its minute - fallback is maxMinLimit
+{
+    // BURST_TRIPPED - this count made the minute suspect and the minute's earlier counts are suspect with it
+    // BURST_SUSPECT - the minute was already suspect
+    time_t minute = now - now % 60;
+    if (minute != burstMinuteStart) {
+        if (burstMinuteCount) burstLearn(Time.hour(burstMinuteStart), min(burstMinuteCount, burstThreshold));
+        burstMinuteStart = minute;
+        burstMinuteCount = 0;
+        burstMinuteSuspect = false;
+        burstThreshold = burstLimit(Time.hour(minute), fallback);
+    }
+    burstMinuteCount++;
+    if (burstMinuteSuspect) return BURST_SUSPECT;
+    if (burstMinuteCount <= burstThreshold) return BURST_OK;
+    burstMinuteSuspect = true;
+    return BURST_TRIPPED;
+}
@@ -21,37 +21,56 @@
 //v1.04a - Fix to 1.04 for non-zero count hours
 //v1.04b - Makes sure reset happens at 2300 hours - so Ubidots counts correctly
 //v1.05 - Updated the Signal reporting for the console / mobile app
-
-
-namespace FRAM {                                    // Moved to namespace instead of #define to limit scope
-  enum Addresses {
-    versionAddr           = 0x0,                    // Where we store the memory map version number
-    debounceAddr          = 0x2,                    // Where we store debounce in dSec or 1/10s of a sec (ie 1.6sec is stored as 16)
-    resetCountAddr        = 0x3,                    // This is where we keep track of how often the Electron was reset
-    timeZoneAddr          = 0x4,                    // Store the local time zone data
-    openTimeAddr          = 0x5,                    // Hour for opening the park / store / etc - military time (e.g. 6 is 6am)
-    closeTimeAddr         = 0x6,                    // Hour for closing of the park / store / etc - military time (e.g 23 is 11pm)
-    controlRegisterAddr   = 0x7,                    // This is the control register for storing the current state
-    currentHourlyCountAddr =0x8,                    // Current Hourly Count - 16 bits
-    currentDailyCountAddr = 0xC,                    // Current Daily Count - 16 bits
-    currentCountsTimeAddr = 0xE,                    // Time of last count - 32 bits
-    alertsCountAddr       = 0x12,                   // Current Hour Alerts Count
-    maxMinLimitAddr       = 0x13,                   // Current value for MaxMin Limit
-  };
-};
-
-const int versionNumber = 9;                        // Increment this number each time the memory map is changed
-const char releaseNumber[6] = "1.05";               // Displays the release on the menu ****  this is not a production release ****
+//v1.06 - Fast resume from deep sleep - retained snapshot lets us go straight back to sleep if the park is still closed
+//v1.07 - Added the Config function - sets a batch of values in one call with a single FRAM commit
+//v1.08 - Added the Status variable - one request for the full device state with the age of each measurement
+//v1.09 - Deadline scheduler - report, open, close, stay awake and webhook times are computed once instead of polled every loop
+//v1.10 - Weekly schedule and closure dates in FRAM - closed days are spent in deep sleep until opening
+//v1.11 - Phase profiler for setup() and each loop() state - only built when PHASE_PROFILING is defined
+//v1.12 - Per-device report offset - spreads the top of the hour reports and wakes over a configurable window
+//v1.13 - Diagnostic log - verbose events are buffered in RAM and FRAM and sent in batches when idle
+//v1.14 - FRAM dump and restore over USB serial - whole image or a named region in checksummed frames
+//v1.15 - Adaptive debounce - learns the window from pulse widths and gaps, Set-Debounce auto or a value to override
+//v1.16 - Reports wait for a usable signal - bounded retries and a forced send once the counts are too old
+//v1.17 - Heap free command parsing and payload formatting - spans and integer / fixed point formatters, no float printf
+//v1.18 - Larger and multiple FRAM chips - sized from the device ID, the log ring fills whatever is past the fixed map
+//v1.19 - Daily rollups - peak hour, busiest minute and inter-arrival percentiles kept for 30 days and sent once a day
+//v1.20 - Counting naps - vehicles are counted in a brief wake and the debounce is slept through, counts join the hour on the deadline wake
+//v1.21 - Failed reports back off with jitter and step up from publish to reconnect, modem cycle and reset - daily radio cap
+//v1.22 - Report transports - the Particle webhook or a direct UDP collector with acks, latency and bytes kept for each
+//v1.23 - Data usage meter - bytes counted at each publish, receive and session, daily and monthly totals, monthly budget
+//v1.24 - Burst detector - learned per hour baseline for counts in a minute, suspect counts are held apart and reported
+//v1.25 - Hour buckets - closed hours are kept under their UTC hour and reported with it until acked, resends are safe
+
+
+#include "FRAM-Map.h"                               // Where everything lives in the FRAM and its version number
+
+const char releaseNumber[6] = "1.25";               // Displays the release on the menu ****  this is not a production release ****
+
+//#define PHASE_PROFILING                           // Uncomment to build in the phase profiler - leave commented out for release
 
 // Included Libraries
+#include "Text-Buffer.h"                            // Heap free parsing and formatting for functions and publishes
+#include "Phase-Profiler.h"                         // Cycle counter timing of setup() and loop() - empty unless PHASE_PROFILING
 #include "Adafruit_FRAM_I2C.h"                      // Library for FRAM functions
 #include "FRAM-Library-Extensions.h"                // Extends the FRAM Library
+#include "Park-Schedule.h"                          // Weekly schedule and closure dates
+#include "Diagnostic-Log.h"                         // Buffered diagnostic log
+#include "Adaptive-Debounce.h"                      // Learns the debounce window from the pulses at this site
+#include "Burst-Detector.h"                         // Learns how many counts a minute is believable for each hour
+#include "Daily-Rollup.h"                           // Daily totals, peaks and inter-arrival percentiles kept for 30 days
+#include "Hour-Buckets.h"                           // Closed hours kept under their UTC hour until acked
+#include "Retry-Controller.h"                       // Backoff and escalation when reports fail
+#include "Data-Usage.h"                             // Cellular data meter and monthly budget
+#include "FRAM-Serial-Transfer.h"                   // FRAM dump and restore over USB serial
+#include "Report-Transport.h"                       // Webhook and direct collector paths for the hourly report
 #include "electrondoc.h"                            // Documents pinout
 
 // Prototypes and System Mode calls
 SYSTEM_MODE(MANUAL);                                // This will enable user code to start executing automatically.
 SYSTEM_THREAD(ENABLED);                             // Means my code will not be held up by Particle processes.
 STARTUP(System.enableFeature(FEATURE_RESET_INFO));
+STARTUP(System.enableFeature(FEATURE_RETAINED_MEMORY));     // Backup SRAM survives deep sleep - used for the fast resume snapshot
 FuelGauge batteryMonitor;                           // Prototype for the fuel gauge (included in Particle core library)
 PMIC power;                                         //Initalize the PMIC class so you can call the Power Management functions below.
 
@@ -72,23 +91,29 @@ const int blueLED =       D7;                       // This LED is on the Electr
 const int userSwitch =    D5;                       // User switch with a pull-up resistor
 // Pin Constants - Sensor
 const int intPin =        B1;                       // Pressure Sensor inerrupt pin
-const int resetPin =      B2;                       // Not currently used - pin that can reset a pressure sensor interrupt
+const int resetPin =      B2;                       // Not currently used - pin that can reset a pressure sensor interrupt - countingNap() sleeps on it as a timer
 const int disableModule = B3;                       // Bringining this low turns on the sensor (pull-up on sensor board)
 const int ledPower =      B4;                       // Allows us to control the indicator LED on the sensor board
 
 
 // Timing Variables
 const int wakeBoundary = 1*3600 + 0*60 + 0;         // 1 hour 0 minutes 0 seconds
+const int maxSleepSeconds = 8*24*3600;              // Longest we will sleep while the park is closed
 const unsigned long stayAwakeLong = 90000;          // In lowPowerMode, how long to stay awake every hour
-const unsigned long webhookWait = 45000;            // How long will we wair for a WebHook response
+const unsigned long webhookWait = 45000;            // How long will we wait for the webhook or collector to ack a report
 const unsigned long resetWait = 30000;              // How long will we wait in ERROR_STATE until reset
 const int publishFrequency = 1000;                  // We can only publish once a second
-unsigned long stayAwakeTimeStamp = 0;               // Timestamps for our timing variables..
-unsigned long stayAwake;                            // Stores the time we need to wait before napping
-unsigned long webhookTimeStamp = 0;                 // Webhooks...
+const unsigned long logFlushInterval = 60000;       // Send the diagnostic log at most this often unless a batch fills up or it is requested
+const unsigned long usageCompactFlushInterval = 3600000;    // And this often once we are saving data
+const int logBatchRecords = 8;                      // About as many records as fit in one publish
 unsigned long resetTimeStamp = 0;                   // Resets - this keeps you from falling into a reset loop
 unsigned long lastPublish = 0;                      // Can only publish 1/sec on avg and 4/sec burst
 
+// Deadline scheduler - upcoming events are computed when config or state changes and the loop just compares against millis()
+enum Deadline { ROLLOVER_DEADLINE, REPORT_DEADLINE, CLOSE_DEADLINE, OPEN_DEADLINE, STAY_AWAKE_DEADLINE, WEBHOOK_DEADLINE, DEADLINE_COUNT };
+unsigned long deadlines[DEADLINE_COUNT];            // In millis() - wall clock events are converted when scheduled
+bool deadlineArmed[DEADLINE_COUNT];                 // Disarmed deadlines are never due
+
 // Program Variables
 int temperatureF;                                   // Global variable so we can monitor via cloud variable
 int resetCount;                                     // Counts the number of times the Electron has had a pin reset
@@ -100,14 +125,62 @@ bool lowPowerMode;                                  // Flag for Low Power Mode o
 bool connectionMode;                                // Need to store if we are going to connect or not in the register
 bool solarPowerMode;                                // Changes the PMIC settings
 bool verboseMode;                                   // Enables more active communications for configutation and setup
+bool logFlushRequested = false;                     // Set by the Flush-Log function
 char SignalString[64];                     // Used to communicate Wireless RSSI and Description
 const char* radioTech[8] = {"Unknown","None","WiFi","GSM","UMTS","CDMA","LTE","IEEE802154"};
+time_t signalTimeStamp = 0;                         // When each measurement was last taken - so Status can report freshness
+time_t temperatureTimeStamp = 0;
+time_t batteryTimeStamp = 0;
+time_t countsTimeStamp = 0;                         // The last count - a copy of currentCountsTime so Status doesn't read the FRAM
+time_t alertsTimeStamp = 0;                         // The last change to alerts - not kept over a reset
+time_t quarantineTimeStamp = 0;                     // The last suspect count
+const int statusRefreshSeconds = 60;                // A Status read asks for battery and temperature to be re-read if they are older than this
+volatile bool statusRefreshRequested = false;       // Set by the Status callback - the reads happen in loop() on the application thread
+int signalQuality = -1;                             // Last measured signal quality in percent - -1 if unknown
+int minSignalQuality;                               // Reports wait for at least this quality - 0 sends whatever the signal
+int maxStaleHours;                                  // A deferred report is sent anyway once it is this old
+const int deferRetryMinutes = 10;                   // First retry after a deferral - doubles each time
+const int deferRetryMaxMinutes = 40;                // Longest wait between retries
+time_t reportDeferredSince = 0;                     // When the current report was first deferred - 0 if it is not deferred
+int reportDeferrals = 0;                            // Times the current report has been deferred
+uint16_t deferredReports = 0;                       // Diagnostics since start-up - deferrals and forced sends
+uint16_t forcedReports = 0;
+bool forceReport = false;                           // The report can't wait - park closing or Send-Now
+bool napCounting;                                   // Naps count vehicles in a brief wake instead of returning to IDLE for each one
+int napPulses = 0;                                  // Vehicles counted in this nap - added to the hour when it ends
+unsigned long reportStartedAt = 0;                  // millis() when this report attempt turned to the radio
+int reportTransportKind;                            // Where reports go - TRANSPORT_WEBHOOK or TRANSPORT_COLLECTOR
+ReportTransport *reportInFlight = &webhookTransport; // The transport the report in flight went out on
 
 // Time Related Variables
 int openTime;                                       // Park Opening time - (24 hr format) sets waking
 int closeTime;                                      // Park Closing time - (24 hr format) sets sleep
 byte currentDailyPeriod;                            // Current day
-byte currentHourlyPeriod;                           // This is where we will know if the period changed
+time_t currentHourStart;                            // Start of the hour hourlyPersonCount belongs to
+time_t reportDueAt = 0;                             // When the oldest closed hour should be sent - 0 waits for the next hour to close
+int jitterWindow;                                   // Reports are spread over this many minutes after the hour
+int reportOffset = 0;                               // This device's place in that window in seconds - from a hash of the device ID
+
+// Weekly schedule - when enabled this replaces openTime / closeTime
+ParkSchedule schedule;
+
+// Retained memory - written just before deep sleep so setup() can skip the full start-up if we only need to go back to sleep
+enum SleepReason { SLEEP_NONE, SLEEP_PARK_CLOSED, SLEEP_LOW_BATTERY };
+struct RetainedSnapshot {
+  uint32_t magic;                                   // Identifies a snapshot written by this firmware
+  int8_t timeZone;                                  // Validated values loaded from FRAM
+  uint8_t openTime;
+  uint8_t closeTime;
+  uint8_t lowBattLimit;
+  uint8_t controlRegister;
+  uint8_t sleepReason;                              // Why we went to sleep - tells the fast path what to check
+  uint16_t reportOffset;                            // So hourly wakes are spread out like our reports
+  ParkSchedule schedule;                            // So the fast path can check the weekly schedule and closure dates
+  uint32_t checksum;                                // Guards against garbage after a power loss
+};
+const uint32_t snapshotMagic = 0x43505338;          // "CPS8" - change this when the snapshot layout changes
+retained RetainedSnapshot snapshot;
+int8_t timeZoneOffset;                              // Keep the validated time zone so we can put it in the snapshot
 
 // Battery monitoring
 int stateOfCharge = 0;                              // stores battery charge level value
@@ -116,12 +189,17 @@ int lowBattLimit;                                   // Trigger for Low Batt Stat
 // This section is where we will initialize sensor specific variables, libraries and function prototypes
 // Pressure Sensor Variables
 int debounce;                                       // This is the numerical value of debounce - in millis()
-char debounceStr[8] = "NA";                         // String to make debounce more readalbe on the mobile app
+char debounceStr[24] = "NA";                         // String to make debounce more readalbe on the mobile app
 volatile bool sensorDetect = false;                 // This is the flag that an interrupt is triggered
 unsigned long currentEvent = 0;                     // Time for the current sensor event
 int hourlyPersonCount = 0;                          // hourly counter
-int hourlyPersonCountSent = 0;                      // Person count in flight to Ubidots
 int dailyPersonCount = 0;                           // daily counter
+int hourlyQuarantine = 0;                           // Counts in minutes the burst detector did not believe - kept apart, not thrown away
+int dailyQuarantine = 0;
+HourBucket reportBucket;                            // The hour in the report in flight
+bool reportOpenHour = false;                        // It is the hour so far rather than a closed one
+bool sendOpenHour = false;                          // Report the hour so far once the closed ones are sent - park closing or Send-Now
+int openHourReported = 0;                           // The count the hour so far was acked with
 
 // These are diagnostic measures that I am playing with
 int alerts = 0;                                     // Alerts are triggered when MaxMinLimit is exceeded or a reset due to errors
@@ -136,7 +214,14 @@ void setup()                                        // Note: Disconnected Setup(
        3) After a reset event
     All three of these have some common code - this will go first then we will set a conditional
     to determine which of the three we are in and finish the code
+    Case 2 usually only needs to confirm we should go back to sleep - fastResume() handles that without the full setup
   */
+  if (fastResume()) return;                         // Only returns true if the sleep call somehow falls through
+  snapshot.magic = 0;                               // Full start-up - the snapshot will be rewritten before the next deep sleep
+  Serial.begin(9600);                               // USB serial - the baud rate is ignored
+  PROFILE_BEGIN();
+  PROFILE_PHASE(PHASE_SETUP);                       // Times the rest of setup()
+
   pinMode(wakeUpPin,INPUT);                         // This pin is active HIGH
   pinMode(resetPin,INPUT_PULLDOWN);                 // Not used but don't want it floating
   pinMode(userSwitch,INPUT);                        // Momentary contact button on board for direct user input
@@ -158,6 +243,7 @@ void setup()                                        // Note: Disconnected Setup(
   char responseTopic[125];
   String deviceID = System.deviceID();              // Multiple Electrons share the same hook - keeps things straight
   deviceID.toCharArray(responseTopic,125);          // Puts the deviceID into the response topic array
+  collectorTransport.setDeviceID(responseTopic);    // The collector frames carry it in binary
   Particle.subscribe(responseTopic, UbidotsHandler, MY_DEVICES);      // Subscribe to the integration response event
 
   Particle.variable("HourlyCount", hourlyPersonCount);                // Define my Particle variables
@@ -173,19 +259,27 @@ void setup()                                        // Note: Disconnected Setup(
   Particle.variable("Debounce",debounceStr);
   Particle.variable("MaxMinLimit",maxMinLimit);
   Particle.variable("Alerts",alerts);
-
-  Particle.function("resetFRAM", resetFRAM);                          // These are the functions exposed to the mobile app and console
-  Particle.function("resetCounts",resetCounts);
-  Particle.function("HardReset",hardResetNow);
-  Particle.function("SendNow",sendNow);
-  Particle.function("LowPowerMode",setLowPowerMode);
-  Particle.function("Solar-Mode",setSolarMode);
-  Particle.function("Verbose-Mode",setVerboseMode);
-  Particle.function("Set-Timezone",setTimeZone);
-  Particle.function("Set-OpenTime",setOpenTime);
-  Particle.function("Set-Close",setCloseTime);
-  Particle.function("Set-Debounce",setDebounce);
-  Particle.function("Set-MaxMin-Limit",setMaxMinLimit);
+  Particle.variable("Status",statusSnapshot);                         // Everything above in one request - built when it is read
+  Particle.variable("DataUsage",usageSnapshot);                       // Bytes used today and this month against the budget
+
+  Particle.function("resetFRAM", usageFunction<resetFRAM>);           // These are the functions exposed to the mobile app and console
+  Particle.function("resetCounts",usageFunction<resetCounts>);        // usageFunction counts the bytes of each call
+  Particle.function("HardReset",usageFunction<hardResetNow>);
+  Particle.function("SendNow",usageFunction<sendNow>);
+  Particle.function("LowPowerMode",usageFunction<setLowPowerMode>);
+  Particle.function("Solar-Mode",usageFunction<setSolarMode>);
+  Particle.function("Verbose-Mode",usageFunction<setVerboseMode>);
+  Particle.function("Set-Timezone",usageFunction<setTimeZone>);
+  Particle.function("Set-OpenTime",usageFunction<setOpenTime>);
+  Particle.function("Set-Close",usageFunction<setCloseTime>);
+  Particle.function("Set-Debounce",usageFunction<setDebounce>);
+  Particle.function("Set-MaxMin-Limit",usageFunction<setMaxMinLimit>);
+  Particle.function("Config",usageFunction<setConfig>);               // Batched version of the Set- functions for provisioning
+  Particle.function("Set-Schedule",usageFunction<setSchedule>);
+  Particle.function("Flush-Log",usageFunction<flushLogNow>);
+#ifdef PHASE_PROFILING
+  Particle.function("Profile",usageFunction<profileReport>);
+#endif
 
   // Load FRAM and reset variables to their correct values
   if (!fram.begin()) state = ERROR_STATE;                             // You can stick the new i2c addr in here, e.g. begin(0x51);
@@ -205,17 +299,38 @@ void setup()                                        // Note: Disconnected Setup(
 
   // Check and import values from FRAM
   debounce = 100*FRAMread8(FRAM::debounceAddr);
-  if (debounce <= 100 || debounce > 2000) debounce = 500;             // We store debounce in dSec so mult by 100 for mSec
-  snprintf(debounceStr,sizeof(debounceStr),"%2.1f sec",(debounce/1000.0));
+  if (debounce < debounceMinMs || debounce > debounceMaxMs) debounce = 500;   // We store debounce in dSec so mult by 100 for mSec
+  debounceBegin();
+  if (debounceLearnedReady()) debounce = learnedDebounce;             // Auto mode - use what this site has taught us
+  showDebounce();
   openTime = FRAMread8(FRAM::openTimeAddr);
   if (openTime < 0 || openTime > 22) openTime = 0;                    // Open and close in 24hr format
   closeTime = FRAMread8(FRAM::closeTimeAddr);
   if (closeTime < 1 || closeTime > 23) closeTime = 23;
-  int8_t tempFRAMvalue = FRAMread8(FRAM::timeZoneAddr);
-  if (tempFRAMvalue >= 12 || tempFRAMvalue <= -12)  Time.zone(-5);    // Default is EST in case proper value not in FRAM
-  else Time.zone((float)tempFRAMvalue);                               // Load Timezone from FRAM
+  FRAMreadBlock(FRAM::scheduleAddr, reinterpret_cast<uint8_t *>(&schedule), sizeof(schedule));
+  if (!scheduleValid(schedule)) schedule.enabled = false;             // Fall back to openTime and closeTime
+  timeZoneOffset = FRAMread8(FRAM::timeZoneAddr);
+  if (timeZoneOffset >= 12 || timeZoneOffset <= -12) timeZoneOffset = -5;   // Default is EST in case proper value not in FRAM
+  Time.zone((float)timeZoneOffset);                                   // Load Timezone from FRAM
   maxMinLimit = FRAMread8(FRAM::maxMinLimitAddr);                     // This is the maximum number of counts in a minute
   if (maxMinLimit < 2 || maxMinLimit > 30) maxMinLimit = 10;          // If value has never been intialized - reasonable value
+  jitterWindow = FRAMread8(FRAM::jitterWindowAddr);
+  if (jitterWindow > 30) jitterWindow = 10;
+  reportOffset = reportOffsetFor(jitterWindow);
+  minSignalQuality = FRAMread8(FRAM::minSignalAddr);
+  if (minSignalQuality > 100) minSignalQuality = 20;
+  maxStaleHours = FRAMread8(FRAM::maxStaleAddr);
+  if (maxStaleHours < 1 || maxStaleHours > 12) maxStaleHours = 3;
+  napCounting = (FRAMread8(FRAM::napCountingAddr) == 1);
+  reportTransportKind = FRAMread8(FRAM::transportAddr);
+  if (reportTransportKind >= TRANSPORT_KIND_COUNT) reportTransportKind = TRANSPORT_WEBHOOK;
+  uint8_t collectorHost[4];
+  FRAMreadBlock(FRAM::collectorHostAddr, collectorHost, sizeof(collectorHost));
+  collectorTransport.host = IPAddress(collectorHost[0], collectorHost[1], collectorHost[2], collectorHost[3]);
+  collectorTransport.port = FRAMread16(FRAM::collectorPortAddr);
+  retryCapMinutes = FRAMread8(FRAM::retryCapAddr);
+  if (retryCapMinutes < 5 || retryCapMinutes > 240) retryCapMinutes = 30;
+  usageBudgetKB = FRAMread16(FRAM::usageBudgetAddr);
 
 
   controlRegisterValue = FRAMread8(FRAM::controlRegisterAddr);        // Read the Control Register for system modes
@@ -223,66 +338,89 @@ void setup()                                        // Note: Disconnected Setup(
   verboseMode     = (0b00001000 & controlRegisterValue);              // verboseMode
   solarPowerMode  = (0b00000100 & controlRegisterValue);              // solarPowerMode
   connectionMode  = (0b00010000 & controlRegisterValue);              // connected mode 1 = connected and 0 = disconnected
+  logBegin();
+  rollupBegin();
+  retryBegin();
+  usageBegin();
+  burstBegin();
+  hourBegin();
+  logLevel = verboseLogLevel();                                       // Verbose mode keeps everything - unless the data budget is short
 
   PMICreset();                                                        // Executes commands that set up the PMIC for Solar charging
 
-  currentHourlyPeriod = Time.hour();                                  // Sets the hour period for when the count starts (see #defines)
   currentDailyPeriod = Time.day();                                    // What day is it?
 
   time_t unixTime = FRAMread32(FRAM::currentCountsTimeAddr);          // Need to reload last recorded event - current periods set from this event
+  countsTimeStamp = unixTime;
   dailyPersonCount = FRAMread16(FRAM::currentDailyCountAddr);         // Load Daily Count from memory
   hourlyPersonCount = FRAMread16(FRAM::currentHourlyCountAddr);       // Load Hourly Count from memory
+  hourlyQuarantine = FRAMread16(FRAM::hourlyQuarantineAddr);          // Suspect counts - they follow the counts through the hours
+  dailyQuarantine = FRAMread16(FRAM::dailyQuarantineAddr);
+  napPulses = FRAMread16(FRAM::napPulsesAddr);                        // Reset during a counting nap - keep what it counted
+  reconcileNapPulses(0);
 
   if (!digitalRead(userSwitch)) {                                     // Rescue mode to locally take lowPowerMode so you can connect to device
     lowPowerMode = false;                                             // Press the user switch while resetting the device
     controlRegisterValue = (0b11111110 & controlRegisterValue);       // Turn off Low power mode
     controlRegisterValue = (0b00010000 | controlRegisterValue);       // Turn on the connectionMode
     FRAMwrite8(FRAM::controlRegisterAddr,controlRegisterValue);       // Write it to the register
-    if ((Time.hour() > closeTime || Time.hour() < openTime))  {       // Device may also be sleeping due to time or TimeZone setting
+    if (!isParkOpen(Time.now()))  {                                   // Device may also be sleeping due to time or TimeZone setting
       openTime = 0;                                                   // Only change these values if it is an issue
       FRAMwrite8(FRAM::openTimeAddr,0);                               // Reset open and close time values to ensure device is awake
       closeTime = 23;
       FRAMwrite8(FRAM::closeTimeAddr,23);
+      schedule.enabled = false;                                       // And the weekly schedule
+      FRAMwrite8(FRAM::scheduleAddr,0);
     }
   }
 
   // Here is where the code diverges based on why we are running Setup()
   // Deterimine when the last counts were taken check when starting test to determine if we reload values or start counts over
-  if (currentDailyPeriod != Time.day(unixTime)) resetEverything();    // Zero the counts for the new day
-  if ((Time.hour() > closeTime || Time.hour() < openTime)) {}         // The park is closed - sleep
+  currentHourStart = Time.now() - Time.now() % 3600;
+  if (hourClosed(unixTime)) {                                         // Reset while closing the hour - the counts are in the ring already
+    hourlyPersonCount = hourlyQuarantine = 0;
+    FRAMwrite16(FRAM::currentHourlyCountAddr, 0);
+    FRAMwrite16(FRAM::hourlyQuarantineAddr, 0);
+  }
+  else if (unixTime && unixTime - unixTime % 3600 != currentHourStart) {  // Counts from an earlier hour - it goes in the ring under its own key
+    currentHourStart = unixTime - unixTime % 3600;
+    closeHour();
+  }
+  if (currentDailyPeriod != Time.day(FRAMread32(FRAM::currentCountsTimeAddr))) {  // Zero the counts for the new day - unless closeHour() just did at 11pm
+    rollupCloseDay(unixTime, dailyPersonCount, alerts, Time.now());  // after keeping a summary of the last one
+    resetEverything();
+  }
+  if (hourCount) reportDueAt = currentHourStart + reportOffset;       // Still need to send the closed hours
+  if (!isParkOpen(Time.now())) {}                                     // The park is closed - sleep
   else {                                                              // Park is open let's get ready for the day
-    attachInterrupt(intPin, sensorISR, RISING);                       // Pressure Sensor interrupt from low to high
+    attachInterrupt(intPin, sensorISR, CHANGE);                       // Pressure Sensor interrupt - both edges so pulses can be timed
     if (connectionMode) {                                             // Only going to connect if we are in connectionMode
       Particle.connect();
       waitFor(Particle.connected,60000);                              // 60 seconds then we timeout  -- *** need to add disconnected option and test
       Particle.process();
     }
     takeMeasurements();                                                 // Populates values so you can read them before the hour
-    stayAwake = stayAwakeLong;                                          // Keeps Electron awake after reboot - helps with recovery
+    setDeadline(STAY_AWAKE_DEADLINE, stayAwakeLong);                    // Keeps Electron awake after reboot - helps with recovery
   }
 
+  scheduleDeadlines();                                                // Work out when the next report, closing and opening are
+
   if (state == INITIALIZATION_STATE) state = IDLE_STATE;              // IDLE unless otherwise from above code
 }
 
 void loop()
 {
+  PROFILE_PHASE(state);                                               // Each pass is charged to the state we started in - less the phases inside it
   switch(state) {
   case IDLE_STATE:                                                    // Where we spend most time - note, the order of these conditionals is important
     if (verboseMode && state != oldState) publishStateTransition();
     if (watchdogFlag) petWatchdog();
+    if (deadlineDue(ROLLOVER_DEADLINE)) closeHour();                  // Top of the hour - before counting so new counts go in the new hour
     if (sensorDetect) recordCount();                                  // The ISR had raised the sensor flag
-    if (hourlyPersonCountSent) {                                      // Cleared here as there could be counts coming in while "in Flight"
-      hourlyPersonCount -= hourlyPersonCountSent;                     // Confirmed that count was recevied - clearing
-      FRAMwrite16(FRAM::currentHourlyCountAddr, static_cast<uint16_t>(hourlyPersonCount));  // Load Hourly Count to memory
-      hourlyPersonCountSent = 0;                                      // Zero out the counts until next reporting period
-      maxMin = 0;
-      alerts = 0;
-      FRAMwrite8(FRAM::alertsCountAddr,0);
-      if (currentHourlyPeriod == 23) resetEverything();                // We have reported for the previous day - reset for the next.
-    }
-    if (lowPowerMode && (millis() - stayAwakeTimeStamp) > stayAwake) state = NAPPING_STATE;  // When in low power mode, we can nap between taps
-    if (Time.hour() != currentHourlyPeriod) state = REPORTING_STATE;  // We want to report on the hour but not after bedtime
-    if ((Time.hour() > closeTime || Time.hour() < openTime)) state = SLEEPING_STATE;   // The park is closed - sleep
+    if (statusRefreshRequested) refreshCheapMeasurements();           // A Status read found them stale - fresh for the next read
+    if (lowPowerMode && deadlineDue(STAY_AWAKE_DEADLINE)) state = NAPPING_STATE;  // When in low power mode, we can nap between taps
+    if (deadlineDue(REPORT_DEADLINE)) state = REPORTING_STATE;        // We want to report on the hour but not after bedtime
+    if (deadlineDue(CLOSE_DEADLINE)) state = SLEEPING_STATE;          // The park is closed - sleep
     if (stateOfCharge <= lowBattLimit) state = LOW_BATTERY_STATE;     // The battery is low - sleep
     break;
 
@@ -291,18 +429,25 @@ void loop()
     detachInterrupt(intPin);                                          // Done sensing for the day
     pinSetFast(disableModule);                                        // Turn off the pressure module for the hour
     pinResetFast(ledPower);                                           // Turn off the LED on the module
-    if (hourlyPersonCount) {                                          // If this number is not zero then we need to send this last count
+    if (usageLevel < USAGE_DAILY && (hourCount || hourlyPersonCount != openHourReported) && retryNotBefore() <= Time.now()) {  // Send this last count - unless backing off or down to one report a day
+      sendOpenHour = true;                                            // Send the hour so far rather than waiting for it to close
+      forceReport = true;                                             // Can't wait for a better signal overnight
       state = REPORTING_STATE;
       break;
     }
     if (connectionMode) {
       Particle.disconnect();
+      usageModem();                                                   // Read the modem data counters before they start over
       Cellular.off();
       delay(1000);
     }
     digitalWrite(blueLED,LOW);                                        // Turn off the LED
     digitalWrite(tmp36Shutdwn, LOW);                                  // Turns off the temp sensor
-    int wakeInSeconds = constrain(wakeBoundary - Time.now() % wakeBoundary, 1, wakeBoundary);
+    scheduleDeadlines();
+    int wakeInSeconds = constrain(secondsUntil(OPEN_DEADLINE), 1, maxSleepSeconds);  // Sleep until we open - watchdog wakes are handled by fastResume()
+    saveSnapshot(SLEEP_PARK_CLOSED);                                  // Lets setup() go straight back to sleep if we are still closed
+    logSpill();                                                       // RAM is lost in deep sleep
+    usageSave();
     System.sleep(SLEEP_MODE_DEEP,wakeInSeconds);                      // Very deep sleep till the next hour - then resets
     } break;
 
@@ -314,18 +459,29 @@ void loop()
       controlRegisterValue = FRAMread8(FRAM::controlRegisterAddr);    // Get the control register (general approach)
       controlRegisterValue = (0b11101111 & controlRegisterValue);     // Turn off connected mode 1 = connected and 0 = disconnected
       connectionMode = false;
+      usageModem();                                                   // Read the modem data counters before they start over
       Cellular.off();
       delay(1000);                                                    // Bummer but only should happen once an hour
       FRAMwrite8(FRAM::controlRegisterAddr,controlRegisterValue);     // Write to the control register
     }
-    stayAwake = debounce;                                             // Once we come into this function, we need to reset stayAwake as it changes at the top of the hour                                                 // Increment the wakes per hour count
-    int wakeInSeconds = constrain(wakeBoundary - Time.now() % wakeBoundary, 1, wakeBoundary);
+    int wakeInSeconds = constrain(min(secondsUntil(REPORT_DEADLINE), secondsUntil(CLOSE_DEADLINE)), 1, wakeBoundary);
     petWatchdog();                                                    // Reset the watchdog
-    System.sleep(intPin, RISING, wakeInSeconds);                      // Sensor will wake us with an interrupt or timeout at the hour
+    if (napCounting) {                                                // Stays asleep apart from a brief wake per vehicle
+      countingNap(constrain(secondsUntil(ROLLOVER_DEADLINE), 1, wakeInSeconds));  // Wakes at the top of the hour so counts land in their hour
+      scheduleDeadlines();
+      debounceNapped();
+      setDeadline(STAY_AWAKE_DEADLINE, 0);                            // Nap again once the deadline is handled
+      state = IDLE_STATE;
+      break;
+    }
+    System.sleep(intPin, RISING, wakeInSeconds);                      // Sensor will wake us with an interrupt or at the next deadline
+    scheduleDeadlines();                                              // millis() stops while napping - re-anchor the wall clock deadlines
+    debounceNapped();                                                 // and the pulse timing
     if (sensorDetect) {
        awokeFromNap=true;                                             // Since millis() stops when sleeping - need this to debounce
-       stayAwakeTimeStamp = millis();
+       setDeadline(STAY_AWAKE_DEADLINE, debounce);                    // Stay up just long enough to finish with this event
     }
+    else setDeadline(STAY_AWAKE_DEADLINE, 0);                         // Woke for a deadline - nap again once it is handled
     state = IDLE_STATE;                                               // Back to the IDLE_STATE after a nap
     } break;
 
@@ -333,6 +489,7 @@ void loop()
     if (verboseMode && state != oldState) publishStateTransition();
     if (connectionMode) {
       Particle.disconnect();
+      usageModem();                                                   // Read the modem data counters before they start over
       Cellular.off();
       delay(1000);
     }
@@ -340,13 +497,18 @@ void loop()
     pinSetFast(disableModule);                                        // Turn off the pressure module for the hour
     pinResetFast(ledPower);                                           // Turn off the LED on the module
     pinResetFast(tmp36Shutdwn);                                       // Turns off the temp sensor
-    int wakeInSeconds = constrain(wakeBoundary - Time.now() % wakeBoundary, 1, wakeBoundary);
+    int wakeInSeconds = constrain(secondsUntil(REPORT_DEADLINE), 1, wakeBoundary);
     petWatchdog();
+    saveSnapshot(SLEEP_LOW_BATTERY);                                  // Lets setup() go straight back to sleep if the battery is still low
+    logSpill();
+    usageSave();
     System.sleep(SLEEP_MODE_DEEP,wakeInSeconds);                      // Very deep sleep till the next hour - then resets
     } break;
 
   case REPORTING_STATE:
     if (verboseMode && state != oldState) publishStateTransition();
+    reportStartedAt = millis();
+    if (retryState.failures) retryEscalate();                         // Earlier attempts failed - take the next step on the ladder
     if (!(0b00010000 & controlRegisterValue)) {
       Cellular.on();
       controlRegisterValue = FRAMread8(FRAM::controlRegisterAddr);      // Get the control register (general approach)
@@ -356,32 +518,48 @@ void loop()
       waitFor(Particle.connected,60000);                                // Give us up to 60 seconds to connect
       Particle.process();
     }
+    if (reportTransportKind == TRANSPORT_COLLECTOR ? !Cellular.ready() : !Particle.connected()) {  // No link - back off and count until the next attempt
+      reportFailed(false);
+      break;
+    }
     takeMeasurements();                                                 // Update Temp, Battery and Signal Strength values
+    if (deferReport()) {                                                // Signal too weak - counts stay pending and we try again later
+      state = IDLE_STATE;
+      break;
+    }
     sendEvent();                                                        // Send data to Ubidots
     state = RESP_WAIT_STATE;                                            // Wait for Response
     break;
 
-  case RESP_WAIT_STATE:
+  case RESP_WAIT_STATE: {
     if (verboseMode && state != oldState) publishStateTransition();
-    if (!dataInFlight)                                                // Response received back to IDLE state
+    TransportResult result = reportInFlight->poll();                  // Collects the ack - the webhook's arrives through UbidotsHandler
+    if (result == TRANSPORT_ACKED || !dataInFlight)                   // Response received back to IDLE state
     {
+      if (dataInFlight) reportAcked();
+      dataInFlight = false;
       state = IDLE_STATE;
-      stayAwake = stayAwakeLong;                                      // Keeps Electron awake after reboot - helps with recovery
-      stayAwakeTimeStamp = millis();
+      clearDeadline(WEBHOOK_DEADLINE);
+      retrySucceeded();
+      setDeadline(STAY_AWAKE_DEADLINE, stayAwakeLong);                // Keeps Electron awake after reboot - helps with recovery
     }
-    else if (millis() - webhookTimeStamp > webhookWait) {             // If it takes too long - will need to reset
-      resetTimeStamp = millis();
-      state = ERROR_STATE;                                            // Response timed out
+    else if (result == TRANSPORT_FAILED || deadlineDue(WEBHOOK_DEADLINE)) {  // An error or no answer - back off and send the same hour again
+      clearDeadline(WEBHOOK_DEADLINE);
+      reportFailed(true);
     }
-    break;
+    } break;
 
   case ERROR_STATE:                                                   // To be enhanced - where we deal with errors
     if (verboseMode && state != oldState) publishStateTransition();
     if (millis() > resetTimeStamp + resetWait)
     {
-      if (Particle.connected()) Particle.publish("State","ERROR_STATE - Resetting");            // Reset time expired - time to go
+      logEvent(LOG_ERROR, LOG_RESETTING, resetCount);                 // Reset time expired - time to go
+      logSpill();
+      usageSave();
+      if (Particle.connected()) usagePublish("State","ERROR_STATE - Resetting",USAGE_EVENTS);
       delay(2000);
       alerts++;
+      alertsTimeStamp = Time.now();
       FRAMwrite8(FRAM::alertsCountAddr,alerts);                       // Save counts in case of reset
       if (resetCount <= 3)  System.reset();                           // Today, only way out is reset
       else {                                                          // If we have had 3 resets - time to do something more
@@ -391,13 +569,19 @@ void loop()
     }
     break;
   }
-  Particle.process();
+  if (usageTrack()) usageLevelChanged();                              // Sessions, keep-alives and the budget level
+  if (logFlushRequested || (state == IDLE_STATE && !dataInFlight)) flushLog();  // Only when the cloud is not busy with a report
+  if (state == IDLE_STATE && !dataInFlight) publishRollup();          // Yesterday's summary once we are connected
+  if (Serial.available()) serialTransfer();                         // Dump or restore request from a laptop on the USB port
+  {
+    PROFILE_PHASE(PHASE_PARTICLE_PROCESS);
+    Particle.process();
+  }
 }
 
 void recordCount() // This is where we check to see if an interrupt is set when not asleep or act on a tap that woke the Arduino
 {
-  static int currentMinuteCount = 0;                                  // What is the count for the current minute
-  static byte currentMinutePeriod;                                    // Current minute
+  PROFILE_PHASE(PHASE_RECORD_COUNT);
 
   pinSetFast(blueLED);                                                // Turn on the blue LED
 
@@ -408,45 +592,30 @@ void recordCount() // This is where we check to see if an interrupt is set when
       delay(10);
     }
 
-    // Diagnostic code
-    if (currentMinutePeriod != Time.minute()) {                       // Done counting for the last minute
-      currentMinutePeriod = Time.minute();                            // Reset period
-      currentMinuteCount = 1;                                         // Reset for the new minute
-    }
-    else currentMinuteCount++;
-
-    if (currentMinuteCount >= maxMin) maxMin = currentMinuteCount;    // Save only if it is the new maxMin
-    // End diagnostic code
-
-    // Fix for multiple counts
-    if (currentMinuteCount >= maxMinLimit) {
-      hourlyPersonCount -= currentMinuteCount;
-      dailyPersonCount -= currentMinuteCount;
-      currentMinuteCount = 0;
-      if (Particle.connected()) Particle.publish("Alert", "Exceeded Maxmin limit");
-      alerts++;
-      FRAMwrite8(FRAM::alertsCountAddr,alerts);                       // Save counts in case of reset
-    }
-
-    hourlyPersonCount++;                                                // Increment the PersonCount
-    FRAMwrite16(FRAM::currentHourlyCountAddr, hourlyPersonCount);       // Load Hourly Count to memory
-    dailyPersonCount++;                                                 // Increment the PersonCount
-    FRAMwrite16(FRAM::currentDailyCountAddr, dailyPersonCount);         // Load Daily Count to memory
-    FRAMwrite32(FRAM::currentCountsTimeAddr, Time.now());             // Write to FRAM - this is so we know when the last counts were saved
-    if (verboseMode && Particle.connected()) {
-      char data[256];                                                   // Store the date in this character array - not global
-      snprintf(data, sizeof(data), "Car, hourly: %i, daily: %i",hourlyPersonCount,dailyPersonCount);
-      Particle.publish("Count",data);                                   // Helpful for monitoring and calibration
+    time_t now = Time.now();
+    BurstVerdict verdict = burstCount(now, maxMinLimit);              // Is this minute still believable for this hour
+    if (burstMinuteCount >= maxMin) maxMin = burstMinuteCount;        // Save only if it is the new maxMin
+
+    if (verdict != BURST_OK) quarantineCount(verdict == BURST_TRIPPED, now);  // Held apart and reported - not counted and not lost
+    else {
+      hourlyPersonCount++;                                              // Increment the PersonCount
+      FRAMwrite16(FRAM::currentHourlyCountAddr, hourlyPersonCount);     // Load Hourly Count to memory
+      dailyPersonCount++;                                               // Increment the PersonCount
+      FRAMwrite16(FRAM::currentDailyCountAddr, dailyPersonCount);       // Load Daily Count to memory
+      FRAMwrite32(FRAM::currentCountsTimeAddr, now);                    // Write to FRAM - this is so we know when the last counts were saved
+      countsTimeStamp = now;
+      rollupRecord(now, burstMinuteCount);                              // Peak hour, busiest minute and gap since the last vehicle
+      logEvent(LOG_DEBUG, LOG_COUNT, hourlyPersonCount, dailyPersonCount);  // Helpful for monitoring and calibration
     }
   }
-  else if(verboseMode && Particle.connected()) Particle.publish("Event","Debounced");
+  else logEvent(LOG_DEBUG, LOG_DEBOUNCED);
 
   if (!digitalRead(userSwitch) && lowPowerMode) {                     // A low value means someone is pushing this button - will trigger a send to Ubidots and take out of low power mode
     Cellular.on();
     Particle.connect();
     waitFor(Particle.connected,60000);                                // Give us up to 60 seconds to connect
     Particle.process();
-    if (Particle.connected()) Particle.publish("Mode","Normal Operations");
+    if (Particle.connected()) usagePublish("Mode","Normal Operations",USAGE_EVENTS);
     controlRegisterValue = FRAMread8(FRAM::controlRegisterAddr);      // Load the control register
     controlRegisterValue = (0b1111110 & controlRegisterValue);        // Will set the lowPowerMode bit to zero
     controlRegisterValue = (0b00010000 | controlRegisterValue);       // Turn on the connectionMode
@@ -459,42 +628,217 @@ void recordCount() // This is where we check to see if an interrupt is set when
   sensorDetect = false;                                               // Reset the flag
 }
 
+void countingNap(int seconds)                                         // Sleeps until a deadline - each vehicle is a brief wake that only counts it
+{
+  // The STM32F2 timers stop in stop mode so the pulses can't be counted in hardware while we sleep. Instead a vehicle
+  // wakes us just long enough to count it, then we sleep through the debounce window with the sensor ignored.
+  time_t wakeAt = Time.now() + seconds;
+  time_t lastPulse = 0;
+  int lockoutSeconds = (debounce + 999) / 1000 + 1;                   // The alarm has whole second steps - never shorter than debounce
+
+  while (Time.now() < wakeAt) {
+    System.sleep(intPin, RISING, max(1, (int)(wakeAt - Time.now())));
+    if (watchdogFlag) petWatchdog();
+    if (!sensorDetect) continue;                                      // The watchdog or the alarm
+    sensorDetect = false;
+    time_t now = Time.now();
+    BurstVerdict verdict = burstCount(now, maxMinLimit);              // Same check as recordCount()
+    if (verdict != BURST_OK) quarantineCount(verdict == BURST_TRIPPED, now);
+    else {
+      napPulses++;
+      FRAMwrite16(FRAM::napPulsesAddr, napPulses);                    // Survives a reset - setup() adds it to the counts
+      rollupRecord(now, burstMinuteCount);
+      lastPulse = now;
+    }
+    if (burstMinuteCount > maxMin) maxMin = burstMinuteCount;
+    if (now + lockoutSeconds < wakeAt) System.sleep(resetPin, RISING, lockoutSeconds);  // Bounce and the other axles fall in here - a timed stop sleep as resetPin is unused and pulled down
+    if (watchdogFlag) petWatchdog();                                  // Don't leave a pulse that came in the lockout until the next vehicle
+    sensorDetect = false;
+  }
+  reconcileNapPulses(lastPulse);
+}
+
+void quarantineCount(bool tripped, time_t now)                        // Holds this count apart - and the minute's earlier counts if it just tripped
+{
+  int earlier = tripped ? burstMinuteCount - 1 : 0;
+  int fromNap = min(earlier, napPulses);                              // In a counting nap they have not joined the hour yet
+  int fromHour = min(earlier - fromNap, hourlyPersonCount);
+  if (fromNap) {
+    napPulses -= fromNap;
+    FRAMwrite16(FRAM::napPulsesAddr, napPulses);
+  }
+  if (fromHour) {
+    hourlyPersonCount -= fromHour;
+    dailyPersonCount -= fromHour;
+    FRAMwrite16(FRAM::currentHourlyCountAddr, hourlyPersonCount);
+    FRAMwrite16(FRAM::currentDailyCountAddr, dailyPersonCount);
+  }
+  rollupDiscard(now, fromNap + fromHour);
+  hourlyQuarantine += fromNap + fromHour + 1;
+  dailyQuarantine += fromNap + fromHour + 1;
+  FRAMwrite16(FRAM::hourlyQuarantineAddr, hourlyQuarantine);
+  FRAMwrite16(FRAM::dailyQuarantineAddr, dailyQuarantine);
+  quarantineTimeStamp = now;
+  if (tripped) {                                                      // Once a minute at most
+    logEvent(LOG_WARN, LOG_BURST, burstMinuteCount, burstThreshold);
+    alerts++;
+    alertsTimeStamp = now;
+    FRAMwrite8(FRAM::alertsCountAddr,alerts);                         // Save counts in case of reset
+  }
+}
+
+void reconcileNapPulses(time_t lastPulse)                             // Adds the vehicles counted while napping to the hour and the day
+{
+  if (!napPulses) return;
+  hourlyPersonCount += napPulses;
+  dailyPersonCount += napPulses;
+  FRAMwrite16(FRAM::currentHourlyCountAddr, hourlyPersonCount);
+  FRAMwrite16(FRAM::currentDailyCountAddr, dailyPersonCount);
+  if (lastPulse) FRAMwrite32(FRAM::currentCountsTimeAddr, countsTimeStamp = lastPulse);  // From setup() we don't know when they came
+  logEvent(LOG_DEBUG, LOG_NAP_COUNTED, napPulses, hourlyPersonCount);
+  napPulses = 0;
+  FRAMwrite16(FRAM::napPulsesAddr, 0);                                // Last - a reset before this counts them twice rather than losing them
+}
 
 void sendEvent()
 {
-  char data[256];                                                     // Store the date in this character array - not global
-  snprintf(data, sizeof(data), "{\"hourly\":%i, \"daily\":%i,\"battery\":%i, \"temp\":%i, \"resets\":%i, \"alerts\":%i, \"maxmin\":%i}",hourlyPersonCount, dailyPersonCount, stateOfCharge, temperatureF, resetCount, alerts, maxMin);
-  Particle.publish("Ubidots-Car-Hook", data, PRIVATE);
-  webhookTimeStamp = millis();
-  currentHourlyPeriod = Time.hour();                                  // Change the time period
-  if(currentHourlyPeriod == 23) hourlyPersonCount++;                  // Ensures we don't have a zero here at midnigtt
-  hourlyPersonCountSent = hourlyPersonCount;                          // This is the number that was sent to Ubidots - will be subtracted once we get confirmation
+  static uint32_t reportSequence = Time.now();                        // Still goes up after a reset
+  reportOpenHour = !hourPeek(0, reportBucket);                        // The oldest closed hour - the hour so far if none are waiting
+  if (reportOpenHour) {
+    reportBucket = {(uint32_t)(currentHourStart / 3600), (uint16_t)hourlyPersonCount, (uint16_t)hourlyQuarantine, (uint16_t)dailyPersonCount};
+    sendOpenHour = false;
+  }
+  Report report = {++reportSequence, reportBucket.hour, (uint32_t)Time.now(), reportBucket.count, reportBucket.daily, reportBucket.quarantine, stateOfCharge, temperatureF, resetCount, alerts, maxMin};
+  reportInFlight = transports[reportTransportKind];
+  reportInFlight->send(report);                                       // A failure to hand it off shows up in RESP_WAIT_STATE
+  setDeadline(WEBHOOK_DEADLINE, webhookWait);                         // How long we will wait for the response
+  reportDueAt = 0;                                                    // Next report is after the next hour closes
+  scheduleDeadlines();
   dataInFlight = true;                                                // set the data inflight flag
 }
 
+void reportAcked()                                                    // The hour in the report is safe with the back office
+{
+  if (reportOpenHour) openHourReported = reportBucket.count;          // Sent again under the same key once the hour closes
+  else hourAcked(reportBucket.hour);
+  maxMin = 0;
+  alerts = 0;
+  alertsTimeStamp = Time.now();
+  FRAMwrite8(FRAM::alertsCountAddr,0);
+  if (hourCount || sendOpenHour) {                                    // More hours waiting - send the next one now
+    reportDueAt = Time.now();
+    scheduleDeadlines();
+  }
+}
+
+void reportFailed(bool sent)                                          // The report did not get through - its hour stays in the ring for the next attempt
+{
+  dataInFlight = false;
+  retryFailed((millis() - reportStartedAt) / 1000, sent ? RETRY_MODEM : RETRY_RESET);  // Once a report has gone out sending it again is safe - a reset won't help
+  reportDueAt = retryState.nextAt;                                    // Try again after the backoff - not at the next hour
+  scheduleDeadlines();
+  logEvent(LOG_WARN, LOG_REPORT_FAILED, retryState.failures, (retryState.nextAt - Time.now()) / 60);
+  setDeadline(STAY_AWAKE_DEADLINE, stayAwakeLong);
+  state = IDLE_STATE;                                                 // Keep counting while we wait
+}
+
+void retryEscalate()                                                  // Stronger fixes as the failures mount - publishing again needs nothing extra
+{
+  logEvent(LOG_INFO, LOG_RETRY_STEP, retryState.action, retryState.radioSeconds);
+  switch (retryState.action) {
+  case RETRY_RECONNECT:                                               // A fresh cloud session
+    Particle.disconnect();
+    waitFor(Particle.disconnected, 15000);
+    break;
+  case RETRY_MODEM:                                                   // Power cycle the modem - it registers with the network again
+    Particle.disconnect();
+    waitFor(Particle.disconnected, 15000);
+    usageModem();                                                     // Read the modem data counters before they start over
+    Cellular.off();
+    delay(1000);
+    Cellular.on();
+    break;
+  case RETRY_RESET:                                                   // Last step - the ladder starts over once we are back up
+    retryResetting();
+    logEvent(LOG_ERROR, LOG_RESETTING, resetCount);
+    logSpill();
+    usageSave();
+    if (resetCount <= 3) System.reset();
+    else {                                                            // Resets are not helping - reset the modem and SIM as well
+      FRAMwrite8(FRAM::resetCountAddr,0);
+      fullModemReset();
+    }
+    break;
+  default:
+    return;
+  }
+  controlRegisterValue = (0b11101111 & controlRegisterValue);         // Not connected - REPORTING_STATE connects again
+}
+
 void UbidotsHandler(const char *event, const char *data)              // Looks at the response from Ubidots - Will reset Photon if no successful response
-{                                                                     // Response Template: "{{hourly.0.status_code}}" so, I should only get a 3 digit number back
-  char dataCopy[strlen(data)+1];                                      // data needs to be copied since if (Particle.connected()) Particle.publish() will clear it
-  strncpy(dataCopy, data, sizeof(dataCopy));                          // Copy - overflow safe
-  if (!strlen(dataCopy)) {                                            // First check to see if there is any data
-    if (Particle.connected()) Particle.publish("Ubidots Hook", "No Data");
+{                                                                     // Response Template: "{{hourly.0.status_code}} {{seq}} {{hour}}" - the code and which report it answers
+  TextSpan response = spanOf(data);                                   // Read in place - we don't publish from here so data stays valid
+  TextSpan code, sequence, hour;
+  if (!nextToken(response, " \"\r\n", code)) {                         // First check to see if there is any data
+    logEvent(LOG_WARN, LOG_WEBHOOK_EMPTY);
     return;
   }
-  int responseCode = atoi(dataCopy);                                  // Response is only a single number thanks to Template
-  if ((responseCode == 200) || (responseCode == 201))
-  {
-    if (Particle.connected()) Particle.publish("State","Response Received");
-    dataInFlight = false;                                             // Data has been received
+  long responseCode = 0, responseSequence = -1, responseHour = -1;   // No sequence or hour matches no report
+  parseLong(code, responseCode);
+  if (nextToken(response, " \"\r\n", sequence)) parseLong(sequence, responseSequence);
+  if (nextToken(response, " \"\r\n", hour)) parseLong(hour, responseHour);
+  if (!webhookTransport.response(responseCode, responseSequence, responseHour, strlen(event) + strlen(data))) {
+    logEvent(LOG_WARN, LOG_WEBHOOK_STALE, responseCode, responseSequence);  // Not for the report in flight - RESP_WAIT_STATE keeps waiting
+    return;
   }
-  else if (Particle.connected()) Particle.publish("Ubidots Hook", dataCopy);                    // Publish the response code
+  if ((responseCode == 200) || (responseCode == 201)) logEvent(LOG_DEBUG, LOG_WEBHOOK_OK);
+  else logEvent(LOG_WARN, LOG_WEBHOOK_ERROR, responseCode);           // Log the response code
 }
 
 // These are the functions that are part of the takeMeasurements call
 void takeMeasurements()
 {
+  PROFILE_PHASE(PHASE_MEASUREMENTS);
   if (Cellular.ready()) getSignalStrength();                          // Test signal strength if the cellular modem is on and ready
   getTemperature();                                                   // Get Temperature at startup as well
   stateOfCharge = int(batteryMonitor.getSoC());                       // Percentage of full charge
+  batteryTimeStamp = Time.now();
+}
+
+void refreshCheapMeasurements()                                       // Battery and temperature - no modem - for the next Status read
+{
+  statusRefreshRequested = false;
+  getTemperature();
+  stateOfCharge = int(batteryMonitor.getSoC());
+  batteryTimeStamp = Time.now();
+}
+
+String statusSnapshot()                                               // Backs the Status variable - only runs when the variable is requested
+{
+  static char data[622];                                              // Variables may be read from the system thread - own buffer up to the variable limit
+  time_t now = Time.now();
+  // Only the values takeMeasurements() cached - no I2C or analog reads here, they would race loop()'s FRAM and fuel
+  // gauge traffic. Stale battery and temperature are re-read by loop() for the next request, signal only when the
+  // modem is up. The ages tell you how stale each one is (-1 is never measured). The count ages are from the last
+  // count, the alert and quarantine ages from the last change to them since the reset (-1 is none yet).
+  if (now - temperatureTimeStamp > statusRefreshSeconds || now - batteryTimeStamp > statusRefreshSeconds) statusRefreshRequested = true;
+  TextBuffer status(data, sizeof(data));
+  status.format("{\"hourly\":%i,\"daily\":%i,\"countAge\":%li,\"soc\":%i,\"socAge\":%li,\"temp\":%i,\"tempAge\":%li,\"signal\":\"%s\",\"sigAge\":%li,\"alerts\":%i,\"alertAge\":%li,\"resets\":%i,\"state\":\"%s\",\"lowPower\":%i,\"log\":%i,\"logLost\":%u,\"debounce\":%i,\"learned\":%i,\"conf\":%i,\"autoDb\":%i,\"sigQ\":%i,\"deferred\":%u,\"forced\":%u,\"fram\":%lu,\"napCount\":%i,\"fails\":%i,\"rung\":%i,\"retryRadio\":%i,\"tx\":\"%s\"",
+    hourlyPersonCount, dailyPersonCount, countsTimeStamp ? (long)(now - countsTimeStamp) : -1L, stateOfCharge, (long)(now - batteryTimeStamp), temperatureF, (long)(now - temperatureTimeStamp),
+    SignalString, signalTimeStamp ? (long)(now - signalTimeStamp) : -1L, alerts, alertsTimeStamp ? (long)(now - alertsTimeStamp) : -1L, resetCount, stateNames[state], lowPowerMode,
+    logPending(), logDropped, debounce, learnedDebounce, debounceConfidence, debounceAuto,
+    signalQuality, deferredReports, forcedReports, (unsigned long)fram.size(), napCounting,
+    retryState.failures, retryState.action, retryState.radioSeconds, transportNames[reportTransportKind]);
+  for (int kind = 0; kind < TRANSPORT_KIND_COUNT; kind++) {           // sent, acked, failed, average mSec to the ack, bytes out and in
+    const TransportStats &stats = transports[kind]->stats;
+    status.format(",\"%s\":[%u,%u,%u,%lu,%lu,%lu]", kind == TRANSPORT_WEBHOOK ? "wh" : "col", stats.sent, stats.acked, stats.failed,
+      stats.acked ? (unsigned long)(stats.latencyTotal / stats.acked) : 0UL, (unsigned long)stats.bytesOut, (unsigned long)stats.bytesIn);
+  }
+  status.format(",\"quar\":[%i,%i],\"quarAge\":%li,\"burstLimit\":%i,\"unsent\":%u,\"dropped\":%u", hourlyQuarantine, dailyQuarantine,
+    quarantineTimeStamp ? (long)(now - quarantineTimeStamp) : -1L, burstThreshold, hourCount, hourDropped);   // Suspect counts this hour and today, closed hours waiting
+  status.format(",\"data\":[%i,%i]}", usagePercent(), usageLevel);   // Percent of the monthly data budget and the level it has us at
+  usageVariableRead(status.length());
+  return String(data);
 }
 
 
@@ -511,7 +855,34 @@ void getSignalStrength()
   //float qualityVal = sig.getQualityValue();
   float qualityPercentage = sig.getQuality();
 
-  snprintf(SignalString,sizeof(SignalString), "%s S:%2.0f%%, Q:%2.0f%% ", radioTech[rat], strengthPercentage, qualityPercentage);
+  TextBuffer(SignalString, sizeof(SignalString)).format("%s S:%2i%%, Q:%2i%% ", radioTech[rat], int(strengthPercentage + 0.5f), int(qualityPercentage + 0.5f));
+  signalQuality = (qualityPercentage < 0) ? -1 : int(qualityPercentage);   // Negative means the modem could not measure it
+  signalTimeStamp = Time.now();
+}
+
+bool deferReport()                                                    // Returns true if the report should wait for a better signal
+{
+  time_t now = Time.now();
+  bool weak = minSignalQuality && signalQuality >= 0 && signalQuality < minSignalQuality;
+  if (weak) {
+    if (!reportDeferredSince) reportDeferredSince = now;
+    int retrySeconds = min(deferRetryMinutes << min(reportDeferrals, 8), deferRetryMaxMinutes) * 60;
+    bool tooOld = now + retrySeconds - reportDeferredSince > maxStaleHours * 3600L;
+    if (!forceReport && !tooOld) {
+      reportDeferrals++;
+      deferredReports++;
+      reportDueAt = now + retrySeconds;
+      scheduleDeadlines();
+      logEvent(LOG_INFO, LOG_REPORT_DEFERRED, signalQuality, retrySeconds / 60);
+      return true;
+    }
+    forcedReports++;
+    logEvent(LOG_WARN, LOG_REPORT_FORCED, signalQuality, (now - reportDeferredSince) / 60);
+  }
+  reportDeferredSince = 0;                                            // Sending - start afresh with the next report
+  reportDeferrals = 0;
+  forceReport = false;
+  return false;
 }
 
 int getTemperature()
@@ -521,13 +892,16 @@ int getTemperature()
   voltage /= 4096.0;                                                  // Electron is different than the Arduino where there are only 1024 steps
   int temperatureC = int(((voltage - 0.5) * 100));                    //converting from 10 mv per degree with 500 mV offset to degrees ((voltage - 500mV) times 100) - 5 degree calibration
   temperatureF = int((temperatureC * 9.0 / 5.0) + 32.0);              // now convert to Fahrenheit
+  temperatureTimeStamp = Time.now();
   return temperatureF;
 }
 
 // Here are the various hardware and timer interrupt service routines
 void sensorISR()
 {
-  sensorDetect = true;                              // sets the sensor flag for the main loop
+  bool rising = pinReadFast(intPin);
+  debounceEdge(rising);                             // Times the pulse for the adaptive debounce
+  if (rising) sensorDetect = true;                  // sets the sensor flag for the main loop
 }
 
 void watchdogISR()
@@ -542,6 +916,177 @@ void petWatchdog()
   watchdogFlag = false;
 }
 
+bool isParkOpen(time_t t)                                             // Single place to decide if the park is open at a given time
+{
+  int hour = Time.hour(t);
+  if (!schedule.enabled) return !(hour > closeTime || hour < openTime);
+  for (int i = 0; i < schedule.holidayCount; i++) {
+    if (schedule.holidays[i][0] == Time.month(t) && schedule.holidays[i][1] == Time.day(t)) return false;  // Closed all day
+  }
+  const uint8_t *today = schedule.weekly[Time.weekday(t) - 1];        // weekday() is 1 for Sunday
+  return !(hour > today[1] || hour < today[0]);                       // An open hour of 24 is closed all day
+}
+
+
+// Report offset - keeps a fleet from all reporting and waking on the same second
+int reportOffsetFor(int windowMinutes)                                // Same offset every time for a device - FNV-1a hash of the device ID
+{
+  if (windowMinutes <= 0) return 0;
+  String deviceID = System.deviceID();
+  uint32_t hash = 2166136261UL;
+  for (unsigned int i = 0; i < deviceID.length(); i++) {
+    hash ^= (uint8_t)deviceID.c_str()[i];
+    hash *= 16777619UL;
+  }
+  return hash % (windowMinutes * 60);
+}
+
+void closeHour()                                                      // The hour's counts go in the ring under its UTC hour - reported from there until acked
+{
+  hourPush(currentHourStart / 3600, hourlyPersonCount, hourlyQuarantine, dailyPersonCount);
+  hourlyPersonCount = hourlyQuarantine = openHourReported = 0;
+  FRAMwrite16(FRAM::currentHourlyCountAddr, 0);                       // After the push - a reset in between is caught by hourClosed() in setup()
+  FRAMwrite16(FRAM::hourlyQuarantineAddr, 0);
+  currentHourStart = Time.now() - Time.now() % 3600;
+  if (Time.hour(currentHourStart) == 23) {                            // The day ends at 11pm so Ubidots counts it right - its hours wait in the ring
+    rollupCloseDay(FRAMread32(FRAM::currentCountsTimeAddr), dailyPersonCount, alerts, Time.now());
+    resetEverything();
+  }
+  reportDueAt = currentHourStart + reportOffset;                      // Report the hour we just closed after our offset
+  int hour = Time.hour(currentHourStart);
+  int reportHours = usageReportHours();
+  if (hour != 23 && (reportHours >= 24 || hour % reportHours)) reportDueAt = 0;  // Short of data - the counts wait to go with a later hour, the 11pm report always goes
+  scheduleDeadlines();
+  usageModem();
+  usageSave();                                                        // Hourly so a reset loses little
+  debounceLearn();                                                    // Hourly look at this site's pulses
+  if (debounceLearnedReady() && learnedDebounce != debounce) {
+    debounce = learnedDebounce;
+    logEvent(LOG_INFO, LOG_DEBOUNCE_LEARNED, learnedDebounce, debounceConfidence);
+  }
+  showDebounce();
+}
+
+void showDebounce()                                                   // Debounce variable - shows the learned window and confidence in auto mode
+{
+  TextBuffer text(debounceStr, sizeof(debounceStr));
+  text.addFixed((debounce + 50) / 100, 1).add(" sec");                // Shown in tenths of a second
+  if (debounceAuto) text.format(" auto %i%%", debounceConfidence);
+}
+
+// Deadline scheduler
+time_t nextParkChange(bool toOpen)                                    // First hour boundary from now where the park is open (or closed)
+{
+  time_t hourStart = Time.now() - Time.now() % 3600;                  // Time zones are whole hours so UTC hours line up with local hours
+  for (int i = 1; i <= 24*8; i++) {                                   // Look ahead a bit more than a week
+    time_t t = hourStart + i * 3600;
+    if (isParkOpen(t) == toOpen) return t;
+  }
+  return 0;                                                           // Never changes - e.g. open 24 hours
+}
+
+void scheduleDeadlines()                                              // Call when the time, park hours or reporting period change
+{
+  time_t now = Time.now();
+  bool open = isParkOpen(now);
+  time_t closeAt = open ? nextParkChange(false) : now;                // Already closed means closing is due now
+  time_t openAt = open ? 0 : nextParkChange(true);
+
+  long rolloverIn = (long)(currentHourStart + 3600 - now);            // Top of the hour after the one we are counting in
+  if (rolloverIn < 0) rolloverIn = 0;                                 // Due now if we slept through it
+  setDeadline(ROLLOVER_DEADLINE, rolloverIn * 1000UL);
+  time_t reportAt = reportDueAt ? reportDueAt : currentHourStart + 3600 + reportOffset;  // Our offset after the hour closes
+  if (retryNotBefore() > reportAt) reportAt = retryNotBefore();       // but not while a failed report is backing off
+  long reportIn = (long)(reportAt - now);
+  if (reportIn < 0) reportIn = 0;
+  setDeadline(REPORT_DEADLINE, reportIn * 1000UL);
+  if (closeAt) setDeadline(CLOSE_DEADLINE, (closeAt - now) * 1000UL);
+  else clearDeadline(CLOSE_DEADLINE);
+  if (openAt) setDeadline(OPEN_DEADLINE, (openAt - now) * 1000UL);
+  else clearDeadline(OPEN_DEADLINE);
+}
+
+void setDeadline(int which, unsigned long fromNow)                    // fromNow is in milliseconds
+{
+  deadlines[which] = millis() + fromNow;
+  deadlineArmed[which] = true;
+}
+
+void clearDeadline(int which)
+{
+  deadlineArmed[which] = false;
+}
+
+bool deadlineDue(int which)
+{
+  return deadlineArmed[which] && (long)(millis() - deadlines[which]) >= 0;  // Signed difference handles millis() rollover
+}
+
+int secondsUntil(int which)                                           // Used to size our sleeps - a disarmed deadline is a long way off
+{
+  if (!deadlineArmed[which]) return wakeBoundary;
+  long remaining = (long)(deadlines[which] - millis());
+  return (remaining <= 0) ? 0 : (remaining + 999) / 1000;
+}
+
+// Fast resume from deep sleep
+uint32_t snapshotChecksum()                                           // Simple FNV-1a over everything but the checksum itself
+{
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&snapshot);
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < offsetof(RetainedSnapshot, checksum); i++) {
+    hash ^= bytes[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+void saveSnapshot(uint8_t reason)                                     // Called just before deep sleep with values already validated in setup()
+{
+  snapshot.magic = snapshotMagic;
+  snapshot.timeZone = timeZoneOffset;
+  snapshot.openTime = openTime;
+  snapshot.closeTime = closeTime;
+  snapshot.lowBattLimit = lowBattLimit;
+  snapshot.controlRegister = controlRegisterValue;
+  snapshot.sleepReason = reason;
+  snapshot.reportOffset = reportOffset;
+  snapshot.schedule = schedule;
+  snapshot.checksum = snapshotChecksum();
+}
+
+bool fastResume()                                                     // Returns false if we need the full setup()
+{
+  if (System.resetReason() != RESET_REASON_POWER_MANAGEMENT) return false;  // Only for a scheduled wake from deep sleep
+  if (snapshot.magic != snapshotMagic || snapshot.checksum != snapshotChecksum()) return false;
+  if (!Time.isValid()) return false;                                  // The RTC keeps time in deep sleep - but make sure
+  pinMode(userSwitch,INPUT);
+  if (!digitalRead(userSwitch)) return false;                         // Rescue mode needs the full setup()
+
+  Time.zone((float)snapshot.timeZone);
+  openTime = snapshot.openTime;
+  closeTime = snapshot.closeTime;
+  schedule = snapshot.schedule;
+  int wakeInSeconds = (snapshot.reportOffset + wakeBoundary - Time.now() % wakeBoundary) % wakeBoundary;  // Our offset after the next hour
+  if (wakeInSeconds == 0) wakeInSeconds = wakeBoundary;
+  if (snapshot.sleepReason == SLEEP_PARK_CLOSED) {
+    if (isParkOpen(Time.now())) return false;                         // Time to open - do the full start-up
+    time_t openAt = nextParkChange(true);                             // Woken early (e.g. by the watchdog) - sleep until opening
+    if (openAt) wakeInSeconds = constrain(openAt - Time.now(), 1, maxSleepSeconds);
+  }
+  else if (snapshot.sleepReason == SLEEP_LOW_BATTERY) {
+    if (int(batteryMonitor.getSoC()) > snapshot.lowBattLimit) return false;  // Battery has recovered
+  }
+  else return false;
+
+  pinMode(donePin,OUTPUT);                                            // Only the pins we need to get back to sleep
+  pinMode(disableModule,OUTPUT);
+  pinSetFast(disableModule);                                          // Keep the pressure module off
+  petWatchdog();
+  System.sleep(SLEEP_MODE_DEEP,wakeInSeconds);                        // Back to sleep - setup() will run again on the next wake
+  return true;
+}
+
 // Power Management function
 void PMICreset() {
   power.begin();                                                      // Settings for Solar powered power management
@@ -584,11 +1129,16 @@ int resetCounts(String command)                                       // Resets
     FRAMwrite8(FRAM::resetCountAddr,0);                               // If so, store incremented number - watchdog must have done This
     FRAMwrite8(FRAM::alertsCountAddr,0);
     alerts = 0;
+    alertsTimeStamp = Time.now();
     resetCount = 0;
     hourlyPersonCount = 0;                                            // Reset count variables
     dailyPersonCount = 0;
-    hourlyPersonCountSent = 0;                                        // In the off-chance there is data in flight
-    dataInFlight = false;
+    dataInFlight = false;                                             // In the off-chance there is data in flight
+    hourlyQuarantine = dailyQuarantine = openHourReported = 0;
+    uint8_t quarantineBlock[4] = {0};                                 // Hourly and daily are next to each other - one write
+    FRAMwriteBlock(FRAM::hourlyQuarantineAddr, quarantineBlock, sizeof(quarantineBlock));
+    hourClear();                                                      // Closed hours waiting to be sent go too
+    rollupOpen(Time.now());                                           // The day's rollup starts over with the counts
     return 1;
   }
   else return 0;
@@ -606,18 +1156,24 @@ int hardResetNow(String command)                                      // Will pe
 
 int setDebounce(String command)                                       // This is the amount of time in seconds we will wait before starting a new session
 {
-  char * pEND;
-  float inputDebounce = strtof(command,&pEND);                        // Looks for the first float and interprets it
-  if ((inputDebounce < 0.0) | (inputDebounce > 5.0)) return 0;        // Make sure it falls in a valid range or send a "fail" result
-  debounce = int(inputDebounce*1000);                                 // debounce is how long we must space events to prevent overcounting
-  int debounceFRAM = constrain(int(inputDebounce*10),1,255);          // Store as a byte in FRAM = 1.6 seconds becomes 16 dSec
-  FRAMwrite8(FRAM::debounceAddr,static_cast<uint8_t>(debounceFRAM));        // Convert to Int16 and store
-  snprintf(debounceStr,sizeof(debounceStr),"%2.1f sec",inputDebounce);
-  if (verboseMode && Particle.connected()) {                                                  // Publish result if feeling verbose
-    waitUntil(meterParticlePublish);
-    Particle.publish("Debounce",debounceStr);
-    lastPublish = millis();
+  if (command == "auto") {                                            // Use the learned window once we are confident in it
+    debounceAuto = true;
+    FRAMwrite8(FRAM::debounceAutoAddr, 1);
+    if (debounceLearnedReady()) debounce = learnedDebounce;
+    showDebounce();
+    logEvent(LOG_INFO, LOG_DEBOUNCE_LEARNED, learnedDebounce, debounceConfidence);
+    return 1;
   }
+  long inputDebounce;                                                 // In mSec - "1.6" seconds is 1600
+  if (!parseFixed(spanOf(command.c_str()), 3, inputDebounce)) return 0;
+  if ((inputDebounce < debounceMinMs) || (inputDebounce > debounceMaxMs)) return 0;  // The range setup() accepts - or it would be lost at the next reset
+  debounce = inputDebounce;                                           // debounce is how long we must space events to prevent overcounting
+  int debounceFRAM = constrain(int(inputDebounce/100),1,255);         // Store as a byte in FRAM = 1.6 seconds becomes 16 dSec
+  FRAMwrite8(FRAM::debounceAddr,static_cast<uint8_t>(debounceFRAM));        // Convert to Int16 and store
+  debounceAuto = false;                                               // A value is a manual override
+  FRAMwrite8(FRAM::debounceAutoAddr, 0);
+  showDebounce();
+  logEvent(LOG_INFO, LOG_DEBOUNCE_SET, debounceFRAM);
   return 1;                                                           // Returns 1 to let the user know if was reset
 }
 
@@ -625,6 +1181,8 @@ int sendNow(String command) // Function to force sending data in current hour
 {
   if (command == "1")
   {
+    sendOpenHour = true;                                              // Send what we have so far this hour - after any closed hours
+    forceReport = true;                                               // Asked for - send whatever the signal
     state = REPORTING_STATE;
     return 1;
   }
@@ -634,11 +1192,16 @@ int sendNow(String command) // Function to force sending data in current hour
 void resetEverything() {                                            // The device is waking up in a new day or is a new install
   FRAMwrite16(FRAM::currentDailyCountAddr, 0);                      // Reset the counts in FRAM as well
   FRAMwrite16(FRAM::currentHourlyCountAddr, 0);
-  FRAMwrite32(FRAM::currentCountsTimeAddr,Time.now());              // Set the time context to the new day
+  countsTimeStamp = Time.now();
+  FRAMwrite32(FRAM::currentCountsTimeAddr,countsTimeStamp);         // Set the time context to the new day
   FRAMwrite8(FRAM::resetCountAddr,0);
   FRAMwrite8(FRAM::alertsCountAddr,0);
   FRAMwrite8(FRAM::alertsCountAddr,0);
-  hourlyPersonCount = dailyPersonCount = resetCount = alerts = 0;   // Reset everything for the day
+  hourlyPersonCount = dailyPersonCount = resetCount = alerts = 0;   // Reset everything for the day - closed hours stay in the ring
+  alertsTimeStamp = countsTimeStamp;
+  hourlyQuarantine = dailyQuarantine = 0;
+  uint8_t quarantineBlock[4] = {0};
+  FRAMwriteBlock(FRAM::hourlyQuarantineAddr, quarantineBlock, sizeof(quarantineBlock));
 }
 
 int setSolarMode(String command) // Function to force sending data in current hour
@@ -650,7 +1213,7 @@ int setSolarMode(String command) // Function to force sending data in current ho
     controlRegisterValue = (0b00000100 | controlRegisterValue);          // Turn on solarPowerMode
     FRAMwrite8(FRAM::controlRegisterAddr,controlRegisterValue);               // Write it to the register
     PMICreset();                                               // Change the power management Settings
-    if (Particle.connected()) Particle.publish("Mode","Set Solar Powered Mode");
+    if (Particle.connected()) usagePublish("Mode","Set Solar Powered Mode",USAGE_EVENTS);
     return 1;
   }
   else if (command == "0")
@@ -660,7 +1223,7 @@ int setSolarMode(String command) // Function to force sending data in current ho
     controlRegisterValue = (0b11111011 & controlRegisterValue);           // Turn off solarPowerMode
     FRAMwrite8(FRAM::controlRegisterAddr,controlRegisterValue);                // Write it to the register
     PMICreset();                                                // Change the power management settings
-    if (Particle.connected()) Particle.publish("Mode","Cleared Solar Powered Mode");
+    if (Particle.connected()) usagePublish("Mode","Cleared Solar Powered Mode",USAGE_EVENTS);
     return 1;
   }
   else return 0;
@@ -671,19 +1234,21 @@ int setVerboseMode(String command) // Function to force sending data in current
   if (command == "1")
   {
     verboseMode = true;
+    logLevel = verboseLogLevel();
     controlRegisterValue = FRAMread8(FRAM::controlRegisterAddr);
     controlRegisterValue = (0b00001000 | controlRegisterValue);                    // Turn on verboseMode
     FRAMwrite8(FRAM::controlRegisterAddr,controlRegisterValue);                        // Write it to the register
-    if (Particle.connected()) Particle.publish("Mode","Set Verbose Mode");
+    if (Particle.connected()) usagePublish("Mode","Set Verbose Mode",USAGE_EVENTS);
     return 1;
   }
   else if (command == "0")
   {
     verboseMode = false;
+    logLevel = verboseLogLevel();
     controlRegisterValue = FRAMread8(FRAM::controlRegisterAddr);
     controlRegisterValue = (0b11110111 & controlRegisterValue);                    // Turn off verboseMode
     FRAMwrite8(FRAM::controlRegisterAddr,controlRegisterValue);                        // Write it to the register
-    if (Particle.connected()) Particle.publish("Mode","Cleared Verbose Mode");
+    if (Particle.connected()) usagePublish("Mode","Cleared Verbose Mode",USAGE_EVENTS);
     return 1;
   }
   else return 0;
@@ -691,43 +1256,48 @@ int setVerboseMode(String command) // Function to force sending data in current
 
 int setTimeZone(String command)
 {
-  char * pEND;
-  char data[256];
   time_t t = Time.now();
-  int8_t tempTimeZoneOffset = strtol(command,&pEND,10);                       // Looks for the first integer and interprets it
+  long tempTimeZoneOffset;
+  if (!parseLong(spanOf(command.c_str()), tempTimeZoneOffset)) return 0;     // Must be a whole number
   if ((tempTimeZoneOffset < -12) | (tempTimeZoneOffset > 12)) return 0;   // Make sure it falls in a valid range or send a "fail" result
   Time.zone((float)tempTimeZoneOffset);
+  timeZoneOffset = tempTimeZoneOffset;
   FRAMwrite8(FRAM::timeZoneAddr,tempTimeZoneOffset);                             // Store the new value in FRAMwrite8
-  snprintf(data, sizeof(data), "Time zone offset %i",tempTimeZoneOffset);
-  if (Particle.connected()) Particle.publish("Time",data);
+  TextBuffer data(publishBuffer, sizeof(publishBuffer));
+  data.format("Time zone offset %li",tempTimeZoneOffset);
+  if (Particle.connected()) usagePublish("Time",data.c_str(),USAGE_EVENTS);
+  scheduleDeadlines();                                                // Local hours have moved
   delay(1000);
-  if (Particle.connected()) Particle.publish("Time",Time.timeStr(t));
+  TextBuffer(publishBuffer, sizeof(publishBuffer)).format("%04i-%02i-%02i %02i:%02i:%02i", Time.year(t), Time.month(t), Time.day(t), Time.hour(t), Time.minute(t), Time.second(t));
+  if (Particle.connected()) usagePublish("Time",publishBuffer,USAGE_EVENTS);
   return 1;
 }
 
 int setOpenTime(String command)
 {
-  char * pEND;
-  char data[256];
-  int tempTime = strtol(command,&pEND,10);                       // Looks for the first integer and interprets it
+  long tempTime;
+  if (!parseLong(spanOf(command.c_str()), tempTime)) return 0;  // Must be a whole number
   if ((tempTime < 0) || (tempTime > 23)) return 0;   // Make sure it falls in a valid range or send a "fail" result
   openTime = tempTime;
   FRAMwrite8(FRAM::openTimeAddr,openTime);                             // Store the new value in FRAMwrite8
-  snprintf(data, sizeof(data), "Open time set to %i",openTime);
-  if (Particle.connected()) Particle.publish("Time",data);
+  scheduleDeadlines();
+  TextBuffer data(publishBuffer, sizeof(publishBuffer));
+  data.format("Open time set to %i",openTime);
+  if (Particle.connected()) usagePublish("Time",data.c_str(),USAGE_EVENTS);
   return 1;
 }
 
 int setCloseTime(String command)
 {
-  char * pEND;
-  char data[256];
-  int tempTime = strtol(command,&pEND,10);                       // Looks for the first integer and interprets it
+  long tempTime;
+  if (!parseLong(spanOf(command.c_str()), tempTime)) return 0;  // Must be a whole number
   if ((tempTime < 0) || (tempTime > 23)) return 0;   // Make sure it falls in a valid range or send a "fail" result
   closeTime = tempTime;
   FRAMwrite8(FRAM::closeTimeAddr,closeTime);                             // Store the new value in FRAMwrite8
-  snprintf(data, sizeof(data), "Closing time set to %i",closeTime);
-  if (Particle.connected()) Particle.publish("Time",data);
+  scheduleDeadlines();
+  TextBuffer data(publishBuffer, sizeof(publishBuffer));
+  data.format("Closing time set to %i",closeTime);
+  if (Particle.connected()) usagePublish("Time",data.c_str(),USAGE_EVENTS);
   return 1;
 }
 
@@ -738,15 +1308,12 @@ int setLowPowerMode(String command)                                   // This is
   controlRegisterValue = FRAMread8(FRAM::controlRegisterAddr);        // Get the control register (general approach)
   if (command == "1")                                                 // Command calls for setting lowPowerMode
   {
-    if (verboseMode && Particle.connected()) {
-      waitUntil(meterParticlePublish);
-      Particle.publish("Mode","Low Power");
-      lastPublish = millis();
-    }
+    logEvent(LOG_INFO, LOG_LOW_POWER, 1);
     if ((0b00010000 & controlRegisterValue)) {                        // If we are in connected mode
       Particle.disconnect();                                          // Otherwise Electron will attempt to reconnect on wake
       controlRegisterValue = (0b11101111 & controlRegisterValue);     // Turn off connected mode 1 = connected and 0 = disconnected
       connectionMode = false;
+      usageModem();                                                   // Read the modem data counters before they start over
       Cellular.off();
       delay(1000);                                                    // Bummer but only should happen once an hour
     }
@@ -755,11 +1322,7 @@ int setLowPowerMode(String command)                                   // This is
   }
   else if (command == "0")                                            // Command calls for clearing lowPowerMode
   {
-    if (verboseMode && Particle.connected()) {
-      waitUntil(meterParticlePublish);
-      Particle.publish("Mode","Normal Operations");
-      lastPublish = millis();
-    }
+    logEvent(LOG_INFO, LOG_LOW_POWER, 0);
     if (!(0b00010000 & controlRegisterValue)) {
       controlRegisterValue = (0b00010000 | controlRegisterValue);    // Turn on connected mode 1 = connected and 0 = disconnected
       Particle.connect();
@@ -775,16 +1338,245 @@ int setLowPowerMode(String command)                                   // This is
 
 int setMaxMinLimit(String command)
 {
-  char * pEND;
-  char data[256];
-  int tempMaxMinLimit = strtol(command,&pEND,10);                       // Looks for the first integer and interprets it
+  long tempMaxMinLimit;
+  if (!parseLong(spanOf(command.c_str()), tempMaxMinLimit)) return 0;  // Must be a whole number
   if ((tempMaxMinLimit < 2) || (tempMaxMinLimit > 30)) return 0;   // Make sure it falls in a valid range or send a "fail" result
   maxMinLimit = tempMaxMinLimit;
   FRAMwrite8(FRAM::maxMinLimitAddr,maxMinLimit);                             // Store the new value in FRAMwrite8
-  snprintf(data, sizeof(data), "MaxMin limit set to %i",maxMinLimit);
-  if (Particle.connected()) Particle.publish("MaxMin",data,PRIVATE);
+  TextBuffer data(publishBuffer, sizeof(publishBuffer));
+  data.format("MaxMin limit set to %i",maxMinLimit);
+  if (Particle.connected()) usagePublish("MaxMin",data.c_str(),PRIVATE,USAGE_EVENTS);
+  return 1;
+}
+
+int setConfig(String command)                                         // Batched configuration - e.g. "open=6,close=21,tz=-5,debounce=1.5,maxmin=10,solar=1,verbose=0,jitter=10,minsig=20,stale=3,napcount=1,retrycap=30,transport=collector,collector=10.0.0.5:8631,budget=3000"
+{
+  TextSpan rest = spanOf(command.c_str());                            // Parsed in place - nothing is copied
+  TextSpan token, key, value;
+  int newTimeZone = timeZoneOffset;                                   // Start from the current values - only the keys sent are changed
+  int newOpenTime = openTime;
+  int newCloseTime = closeTime;
+  int newDebounce = -1;                                               // Unchanged unless sent - debounce may be the learned value
+  int newDebounceAuto = debounceAuto;
+  int newMaxMinLimit = maxMinLimit;
+  int newSolar = solarPowerMode;
+  int newVerbose = verboseMode;
+  int newJitter = jitterWindow;
+  int newMinSignal = minSignalQuality;
+  int newMaxStale = maxStaleHours;
+  int newNapCounting = napCounting;
+  int newRetryCap = retryCapMinutes;
+  long newBudget = usageBudgetKB;
+  int newTransport = reportTransportKind;
+  uint8_t newCollectorHost[4] = {collectorTransport.host[0], collectorTransport.host[1], collectorTransport.host[2], collectorTransport.host[3]};
+  uint16_t newCollectorPort = collectorTransport.port;
+  int changes = 0;
+
+  while (nextToken(rest, ",; ", token)) {
+    if (!splitAt(token, '=', key, value)) return 0;                   // Every token has to be key=value
+    if (spanIs(key, "debounce")) {
+      long inputDebounce;                                             // In mSec
+      if (spanIs(value, "auto")) newDebounceAuto = 1;
+      else {
+        if (!parseFixed(value, 3, inputDebounce) || (inputDebounce < debounceMinMs) || (inputDebounce > debounceMaxMs)) return 0;
+        newDebounce = inputDebounce;
+        newDebounceAuto = 0;                                          // A value is a manual override
+      }
+    }
+    else if (spanIs(key, "transport")) {
+      if (spanIs(value, "webhook")) newTransport = TRANSPORT_WEBHOOK;
+      else if (spanIs(value, "collector")) newTransport = TRANSPORT_COLLECTOR;
+      else return 0;
+    }
+    else if (spanIs(key, "collector")) {                              // address:port
+      if (!parseCollector(value, newCollectorHost, newCollectorPort)) return 0;
+    }
+    else {
+      long inputValue;
+      if (!parseLong(value, inputValue)) return 0;                    // Must be a whole number
+      if (spanIs(key, "tz") && inputValue >= -12 && inputValue <= 12) newTimeZone = inputValue;
+      else if (spanIs(key, "open") && inputValue >= 0 && inputValue <= 23) newOpenTime = inputValue;
+      else if (spanIs(key, "close") && inputValue >= 0 && inputValue <= 23) newCloseTime = inputValue;
+      else if (spanIs(key, "maxmin") && inputValue >= 2 && inputValue <= 30) newMaxMinLimit = inputValue;
+      else if (spanIs(key, "solar") && (inputValue == 0 || inputValue == 1)) newSolar = inputValue;
+      else if (spanIs(key, "verbose") && (inputValue == 0 || inputValue == 1)) newVerbose = inputValue;
+      else if (spanIs(key, "jitter") && inputValue >= 0 && inputValue <= 30) newJitter = inputValue;
+      else if (spanIs(key, "minsig") && inputValue >= 0 && inputValue <= 100) newMinSignal = inputValue;
+      else if (spanIs(key, "stale") && inputValue >= 1 && inputValue <= 12) newMaxStale = inputValue;
+      else if (spanIs(key, "napcount") && (inputValue == 0 || inputValue == 1)) newNapCounting = inputValue;
+      else if (spanIs(key, "retrycap") && inputValue >= 5 && inputValue <= 240) newRetryCap = inputValue;
+      else if (spanIs(key, "budget") && inputValue >= 0 && inputValue <= 65535) newBudget = inputValue;   // KB a month - 0 is no budget
+      else return 0;                                                  // Unknown key or out of range - nothing has been changed yet
+    }
+    changes++;
+  }
+  if (!changes) return 0;
+  if (newTransport == TRANSPORT_COLLECTOR && !newCollectorPort) return 0;   // Nowhere to send to
+
+  // Everything validated - now apply and commit the whole block to FRAM in one write
+  uint8_t block[configBlockSize];
+  FRAMreadBlock(FRAM::debounceAddr, block, sizeof(block));
+  controlRegisterValue = block[FRAM::controlRegisterAddr - FRAM::debounceAddr];
+  controlRegisterValue = newSolar ? (0b00000100 | controlRegisterValue) : (0b11111011 & controlRegisterValue);
+  controlRegisterValue = newVerbose ? (0b00001000 | controlRegisterValue) : (0b11110111 & controlRegisterValue);
+  if (newDebounce >= 0) block[FRAM::debounceAddr - FRAM::debounceAddr] = constrain(newDebounce/100,1,255);  // Stored in dSec
+  block[FRAM::timeZoneAddr - FRAM::debounceAddr] = static_cast<uint8_t>(newTimeZone);
+  block[FRAM::openTimeAddr - FRAM::debounceAddr] = newOpenTime;
+  block[FRAM::closeTimeAddr - FRAM::debounceAddr] = newCloseTime;
+  block[FRAM::controlRegisterAddr - FRAM::debounceAddr] = controlRegisterValue;
+  block[FRAM::maxMinLimitAddr - FRAM::debounceAddr] = newMaxMinLimit;
+  block[FRAM::jitterWindowAddr - FRAM::debounceAddr] = newJitter;
+  block[FRAM::debounceAutoAddr - FRAM::debounceAddr] = newDebounceAuto;
+  block[FRAM::minSignalAddr - FRAM::debounceAddr] = newMinSignal;
+  block[FRAM::maxStaleAddr - FRAM::debounceAddr] = newMaxStale;
+  block[FRAM::napCountingAddr - FRAM::debounceAddr] = newNapCounting;
+  block[FRAM::retryCapAddr - FRAM::debounceAddr] = newRetryCap;
+  block[FRAM::transportAddr - FRAM::debounceAddr] = newTransport;
+  memcpy(block + FRAM::collectorHostAddr - FRAM::debounceAddr, newCollectorHost, sizeof(newCollectorHost));
+  block[FRAM::collectorPortAddr - FRAM::debounceAddr] = newCollectorPort & 0xFF;   // Low byte first as FRAMread16() wants it
+  block[FRAM::collectorPortAddr + 1 - FRAM::debounceAddr] = newCollectorPort >> 8;
+  block[FRAM::usageBudgetAddr - FRAM::debounceAddr] = newBudget & 0xFF;
+  block[FRAM::usageBudgetAddr + 1 - FRAM::debounceAddr] = newBudget >> 8;
+  FRAMwriteBlock(FRAM::debounceAddr, block, sizeof(block));
+
+  debounceAuto = newDebounceAuto;
+  if (debounceLearnedReady()) debounce = learnedDebounce;
+  else if (newDebounce >= 0) debounce = newDebounce;
+  showDebounce();
+  timeZoneOffset = newTimeZone;
+  Time.zone((float)timeZoneOffset);
+  openTime = newOpenTime;
+  closeTime = newCloseTime;
+  maxMinLimit = newMaxMinLimit;
+  verboseMode = newVerbose;
+  jitterWindow = newJitter;
+  reportOffset = reportOffsetFor(jitterWindow);
+  minSignalQuality = newMinSignal;
+  maxStaleHours = newMaxStale;
+  napCounting = newNapCounting;
+  retryCapMinutes = newRetryCap;
+  collectorTransport.host = IPAddress(newCollectorHost[0], newCollectorHost[1], newCollectorHost[2], newCollectorHost[3]);
+  collectorTransport.port = newCollectorPort;
+  reportTransportKind = newTransport;
+  if (newBudget != usageBudgetKB) {
+    usageBudgetKB = newBudget;
+    usageLevel = usageLevelFor();
+  }
+  logLevel = verboseLogLevel();
+  scheduleDeadlines();                                                // Park hours or time zone may have changed
+  if (solarPowerMode != (bool)newSolar) {
+    solarPowerMode = newSolar;
+    PMICreset();                                                      // Only touch the power management settings if they changed
+  }
+
+  TextBuffer data(publishBuffer, sizeof(publishBuffer));
+  data.format("tz:%i open:%i close:%i debounce:%s maxmin:%i solar:%i verbose:%i jitter:%i minsig:%i stale:%i napcount:%i retrycap:%i transport:%s budget:%i",timeZoneOffset,openTime,closeTime,debounceStr,maxMinLimit,solarPowerMode,verboseMode,jitterWindow,minSignalQuality,maxStaleHours,napCounting,retryCapMinutes,transportNames[reportTransportKind],usageBudgetKB);
+  if (Particle.connected()) {                                         // One summary publish for the whole batch
+    waitUntil(meterParticlePublish);
+    usagePublish("Config",data.c_str(),PRIVATE,USAGE_EVENTS);
+    lastPublish = millis();
+  }
+  return changes;                                                     // Number of values that were set
+}
+
+int setSchedule(String command)                                       // Weekly schedule and closures - e.g. "on,all=8-20,sat=10-16,sun=closed,hol=12/25,unhol=7/4"
+{
+  TextSpan rest = spanOf(command.c_str());                            // Parsed in place - nothing is copied
+  TextSpan token, key, value, first, second;
+  ParkSchedule newSchedule = schedule;                                // Work on a copy - nothing changes unless every token is valid
+  int changes = 0;
+
+  while (nextToken(rest, ",; ", token)) {
+    changes++;
+    if (spanIs(token, "on") || spanIs(token, "off")) {                // Turn the weekly schedule on or off - off goes back to openTime / closeTime
+      newSchedule.enabled = spanIs(token, "on");
+      continue;
+    }
+    if (!splitAt(token, '=', key, value)) return 0;
+    if (spanIs(key, "hol") || spanIs(key, "unhol")) {                 // Closure dates as month/day
+      if (spanIs(value, "clear")) {
+        newSchedule.holidayCount = 0;
+        continue;
+      }
+      long month, day;
+      if (!splitAt(value, '/', first, second) || !parseLong(first, month) || !parseLong(second, day)) return 0;
+      if (!scheduleDateValid(month, day)) return 0;                  // 2/31 is a typo
+      int found = -1;
+      for (int i = 0; i < newSchedule.holidayCount; i++) {
+        if (newSchedule.holidays[i][0] == month && newSchedule.holidays[i][1] == day) found = i;
+      }
+      if (spanIs(key, "hol") && found < 0) {
+        if (newSchedule.holidayCount >= maxHolidays) return 0;        // List is full
+        newSchedule.holidays[newSchedule.holidayCount][0] = month;
+        newSchedule.holidays[newSchedule.holidayCount][1] = day;
+        newSchedule.holidayCount++;
+      }
+      else if (spanIs(key, "unhol") && found >= 0) {               // Move the last date into the gap
+        newSchedule.holidayCount--;
+        newSchedule.holidays[found][0] = newSchedule.holidays[newSchedule.holidayCount][0];
+        newSchedule.holidays[found][1] = newSchedule.holidays[newSchedule.holidayCount][1];
+      }
+      continue;
+    }
+    long open = 24, close = 0;                                        // "closed" is open 24 - never open
+    if (!spanIs(value, "closed")) {
+      if (!splitAt(value, '-', first, second) || !parseLong(first, open) || !parseLong(second, close)) return 0;
+      if (open > 23 || !scheduleHoursValid(open, close)) return 0;    // Open has to come before close
+    }
+    bool matched = false;
+    for (int day = 0; day < 7; day++) {
+      if (spanIs(key, "all") || spanIs(key, dayNames[day])) {
+        newSchedule.weekly[day][0] = open;
+        newSchedule.weekly[day][1] = close;
+        matched = true;
+      }
+    }
+    if (!matched) return 0;                                           // Unknown day
+  }
+  if (!changes || !scheduleValid(newSchedule)) return 0;
+
+  schedule = newSchedule;
+  FRAMwriteBlock(FRAM::scheduleAddr, reinterpret_cast<const uint8_t *>(&schedule), sizeof(schedule));  // One commit
+  scheduleDeadlines();
+
+  TextBuffer data(publishBuffer, sizeof(publishBuffer));
+  data.add(schedule.enabled ? "on" : "off");
+  for (int day = 0; day < 7; day++) {
+    if (schedule.weekly[day][0] > 23) data.format(" %s:closed", dayNames[day]);
+    else data.format(" %s:%i-%i", dayNames[day], schedule.weekly[day][0], schedule.weekly[day][1]);
+  }
+  data.format(" closures:%i", schedule.holidayCount);
+  if (Particle.connected()) {
+    waitUntil(meterParticlePublish);
+    usagePublish("Schedule",data.c_str(),PRIVATE,USAGE_EVENTS);
+    lastPublish = millis();
+  }
+  return 1;
+}
+
+#ifdef PHASE_PROFILING
+int profileReport(String command)                                     // "1" sends the summary to Serial and the console - "reset" clears it
+{
+  char line[200];
+  if (command == "reset") {
+    memset(phaseStats, 0, sizeof(phaseStats));
+    return 1;
+  }
+  if (command != "1") return 0;
+  Serial.printlnf("Boot to setup: %lu ms", bootMillis);
+  for (int phase = 0; phase < PHASE_COUNT; phase++) {
+    if (!phaseStats[phase].count) continue;
+    profilerSummary(phase, line, sizeof(line));
+    Serial.println(line);
+    if (Particle.connected()) {
+      waitUntil(meterParticlePublish);
+      usagePublish("Profile",line,PRIVATE,USAGE_EVENTS);
+      lastPublish = millis();
+    }
+  }
   return 1;
 }
+#endif
 
 bool meterParticlePublish(void)
 {
@@ -792,19 +1584,73 @@ bool meterParticlePublish(void)
   else return 0;
 }
 
-void publishStateTransition(void)
+int verboseLogLevel()                                                 // Verbose mode keeps everything - not once the data budget is getting short
+{
+  return (verboseMode && usageLevel == USAGE_NORMAL) ? LOG_DEBUG : LOG_WARN;
+}
+
+void usageLevelChanged()                                              // Steps operation up or down with the data budget
+{
+  logLevel = verboseLogLevel();
+  logEvent(LOG_WARN, LOG_USAGE_LEVEL, usageLevel, usagePercent());
+  usageSave();
+}
+
+void publishStateTransition(void)                                     // Logged rather than published so we don't wait on the cloud
 {
   char stateTransitionString[40];
-  snprintf(stateTransitionString, sizeof(stateTransitionString), "From %s to %s", stateNames[oldState],stateNames[state]);
+  TextBuffer(stateTransitionString, sizeof(stateTransitionString)).format("From %s to %s", stateNames[oldState],stateNames[state]);
+  logEvent(LOG_DEBUG, LOG_STATE, oldState, state);
   oldState = state;
-  if(Particle.connected()) {
-    waitUntil(meterParticlePublish);
-    Particle.publish("State Transition",stateTransitionString);
-    lastPublish = millis();
-  }
   Serial.println(stateTransitionString);
 }
 
+void flushLog()                                                       // Sends the oldest log records as one batched publish
+{
+  static unsigned long lastFlush = 0;
+  TextBuffer batch(publishBuffer, sizeof(publishBuffer));             // Keep within the publish limit for all Device OS versions
+  char line[64];
+  int records = 0;
+  LogRecord record;
+
+  if (!logPending()) {
+    logFlushRequested = false;
+    return;
+  }
+  if (!Particle.connected() || !meterParticlePublish()) return;       // Never wait - try again on the next loop
+  if (!logFlushRequested && usageLevel >= USAGE_BATCHED) return;      // Short of data - the log waits in FRAM unless it is asked for
+  unsigned long interval = (usageLevel >= USAGE_COMPACT) ? usageCompactFlushInterval : logFlushInterval;
+  if (!logFlushRequested && logPending() < logBatchRecords && millis() - lastFlush < interval) return;
+  while (logPeek(records, record)) {
+    int lineLength = logFormat(record, line, sizeof(line));
+    if (batch.length() + lineLength + 2 > (int)sizeof(publishBuffer)) break;
+    if (records) batch.add('\n');
+    batch.add(line);
+    records++;
+  }
+  if (usagePublish("Log", batch.c_str(), PRIVATE, USAGE_LOG)) logPop(records);      // Keep them for next time if the publish failed
+  lastPublish = lastFlush = millis();
+}
+
+void publishRollup()                                                  // Sends the oldest unsent daily summary
+{
+  if (!rollupUnsent || !Particle.connected() || !meterParticlePublish()) return;   // Never wait - try again on the next loop
+  if (usageLevel >= USAGE_BATCHED) return;                            // Short of data - the ring keeps them until there is more
+  if (!rollupSummary(rollupCount - rollupUnsent, publishBuffer, sizeof(publishBuffer))) return;
+  if (usagePublish("Daily", publishBuffer, PRIVATE, USAGE_REPORT)) rollupSent();
+  lastPublish = millis();
+}
+
+int flushLogNow(String command)                                       // Sends everything in the log - one publish a second until it is empty
+{
+  if (command == "1")
+  {
+    logFlushRequested = true;
+    return logPending();
+  }
+  else return 0;
+}
+
 void fullModemReset() {  // Adapted form Rikkas7's https://github.com/rickkas7/electronsample
 	Particle.disconnect(); 	                                         // Disconnect from the cloud
 	unsigned long startTime = millis();  	                           // Wait up to 15 seconds to disconnect
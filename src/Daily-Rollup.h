@@ -0,0 +1,185 @@
+// Daily Rollup Header File
+// Summaries of each day worked out on the device as the counts come in. Every counted vehicle updates its hour's
+// total, the busiest minute and a log scale histogram of the seconds since the last vehicle - a few bytes written
+// per count, nothing rescanned. When the day closes its total, peak hour, busiest minute and inter-arrival
+// percentiles go into a 30 day ring in FRAM and are sent as one small Daily publish with the 7 and 30 day totals.
+// Days follow the device's own daily reset - closeHour() at the start of the 11pm hour, or setup() waking on a new
+// day - so they line up with the daily count in Ubidots. The day's hours wait in the hour ring until they are sent.
+
+#include <stddef.h>
+
+const int rollupDays = 30;                          // Days kept in the FRAM ring
+const int rollupGapBuckets = 20;
+const uint16_t rollupGapEdges[rollupGapBuckets] = {0, 2, 4, 6, 9, 13, 19, 28, 42, 63, 95, 142, 213, 320, 480,
+    720, 1080, 1620, 2430, 3645};                   // Lower edge of each bucket in seconds - steps of about 1.5x
+const unsigned long rollupMaxGap = 6 * 3600UL;      // Longer gaps are the park being closed, not traffic
+
+struct __attribute__((packed)) RollupToday {        // 95 bytes in FRAM - the day so far
+    uint32_t opened;                                // Time.now() when the day started - 0 if there is no day open
+    uint16_t hours[24];                             // Counts for each local hour
+    uint16_t busiestMinute;                         // Minute of the day with the most counts
+    uint8_t busiestMinuteCount;
+    uint16_t gaps[rollupGapBuckets];                // Seconds between counted vehicles
+};
+
+struct __attribute__((packed)) RollupDay {          // 17 bytes in the FRAM ring - one closed day
+    uint16_t day;                                   // Local days since 1970
+    uint16_t total;
+    uint8_t peakHour;
+    uint16_t peakHourCount;
+    uint16_t busiestMinute;
+    uint8_t busiestMinuteCount;
+    uint16_t gapP25;                                // Inter-arrival percentiles in seconds - to the middle of the bucket
+    uint16_t gapP50;
+    uint16_t gapP90;
+    uint8_t alerts;
+};
+
+RollupToday rollupToday;                            // RAM copy - the FRAM copy is updated field by field
+time_t rollupLastArrival = 0;                       // Time of the last counted vehicle
+uint8_t rollupHead = 0;                             // Oldest day in the ring
+uint8_t rollupCount = 0;                            // Days in the ring
+uint8_t rollupUnsent = 0;                           // The newest days that have not been published yet
+
+uint16_t rollupLocalDay(time_t t)
+{
+    return (t + (long)(Time.zone() * 3600)) / 86400;
+}
+
+void rollupSave(size_t offset, size_t length)       // Write part of today's rollup back to FRAM
+{
+    FRAMwriteBlock(FRAM::rollupTodayAddr + offset, reinterpret_cast<const uint8_t *>(&rollupToday) + offset, length);
+}
+
+void rollupOpen(time_t now)                         // Start an empty day
+{
+    memset(&rollupToday, 0, sizeof(rollupToday));
+    rollupToday.opened = now;
+    rollupSave(0, sizeof(rollupToday));
+}
+
+void rollupBegin()                                  // Reload the day so far and the ring position
+{
+    FRAMreadBlock(FRAM::rollupTodayAddr, reinterpret_cast<uint8_t *>(&rollupToday), sizeof(rollupToday));
+    rollupHead = FRAMread8(FRAM::rollupHeadAddr);
+    rollupCount = FRAMread8(FRAM::rollupCountAddr);
+    rollupUnsent = FRAMread8(FRAM::rollupUnsentAddr);
+    if (rollupHead >= rollupDays || rollupCount > rollupDays || rollupUnsent > rollupCount) rollupHead = rollupCount = rollupUnsent = 0;
+    rollupLastArrival = FRAMread32(FRAM::currentCountsTimeAddr);
+    if (!rollupToday.opened) rollupOpen(Time.now());
+}
+
+void rollupRecord(time_t now, int minuteCount)      // Called for each counted vehicle - minuteCount is this minute's count so far
+{
+    int hour = Time.hour(now);
+    if (rollupToday.hours[hour] < 0xFFFF) rollupToday.hours[hour]++;
+    rollupSave(offsetof(RollupToday, hours) + hour * sizeof(uint16_t), sizeof(uint16_t));
+
+    if (minuteCount > rollupToday.busiestMinuteCount) {
+        rollupToday.busiestMinute = hour * 60 + Time.minute(now);
+        rollupToday.busiestMinuteCount = min(minuteCount, 255);
+        rollupSave(offsetof(RollupToday, busiestMinute), sizeof(uint16_t) + sizeof(uint8_t));
+    }
+
+    unsigned long gap = now - rollupLastArrival;
+    if (rollupLastArrival >= (time_t)rollupToday.opened && now >= rollupLastArrival && gap < rollupMaxGap) {
+        int i = rollupGapBuckets - 1;
+        while (i > 0 && gap < rollupGapEdges[i]) i--;
+        if (rollupToday.gaps[i] < 0xFFFF) rollupToday.gaps[i]++;
+        rollupSave(offsetof(RollupToday, gaps) + i * sizeof(uint16_t), sizeof(uint16_t));
+    }
+    rollupLastArrival = now;
+}
+
+void rollupDiscard(time_t now, int count)           // Counts taken back out by the maxMinLimit check
+{
+    int hour = Time.hour(now);
+    rollupToday.hours[hour] -= min(count, (int)rollupToday.hours[hour]);
+    rollupSave(offsetof(RollupToday, hours) + hour * sizeof(uint16_t), sizeof(uint16_t));
+}
+
+uint16_t rollupGapPercentile(int percent)           // From the histogram - accurate to the bucket
+{
+    unsigned long samples = 0, seen = 0;
+    for (int i = 0; i < rollupGapBuckets; i++) samples += rollupToday.gaps[i];
+    if (!samples) return 0;
+    unsigned long target = (samples * percent + 99) / 100;
+    for (int i = 0; i < rollupGapBuckets - 1; i++) {
+        seen += rollupToday.gaps[i];
+        if (seen >= target) return (rollupGapEdges[i] + rollupGapEdges[i + 1]) / 2;
+    }
+    return rollupGapEdges[rollupGapBuckets - 1];
+}
+
+bool rollupPeek(int index, RollupDay &day)          // index 0 is the oldest day in the ring
+{
+    if (index < 0 || index >= rollupCount) return false;
+    int slot = (rollupHead + index) % rollupDays;
+    FRAMreadBlock(FRAM::rollupDaysAddr + slot * sizeof(RollupDay), reinterpret_cast<uint8_t *>(&day), sizeof(RollupDay));
+    return true;
+}
+
+void rollupCloseDay(time_t lastCount, int total, int alertCount, time_t now)
+{
+    // Closes the day the last count belongs to - called before any count in the new day
+    RollupDay closed, newest;
+    closed.day = rollupLocalDay(lastCount);
+    if (!rollupToday.opened || lastCount < (time_t)rollupToday.opened || (rollupPeek(rollupCount - 1, newest) && newest.day == closed.day)) {
+        rollupOpen(now);                            // Nothing counted since it opened or this day is already closed - late counts go with the daily count
+        return;
+    }
+    closed.total = constrain(total, 0, 0xFFFF);
+    closed.peakHour = 0;
+    for (int hour = 1; hour < 24; hour++) if (rollupToday.hours[hour] > rollupToday.hours[closed.peakHour]) closed.peakHour = hour;
+    closed.peakHourCount = rollupToday.hours[closed.peakHour];
+    closed.busiestMinute = rollupToday.busiestMinute;
+    closed.busiestMinuteCount = rollupToday.busiestMinuteCount;
+    closed.gapP25 = rollupGapPercentile(25);
+    closed.gapP50 = rollupGapPercentile(50);
+    closed.gapP90 = rollupGapPercentile(90);
+    closed.alerts = constrain(alertCount, 0, 255);
+
+    if (rollupCount == rollupDays) {                // Full - drop the oldest
+        rollupHead = (rollupHead + 1) % rollupDays;
+        rollupCount--;
+    }
+    int slot = (rollupHead + rollupCount) % rollupDays;
+    FRAMwriteBlock(FRAM::rollupDaysAddr + slot * sizeof(RollupDay), reinterpret_cast<const uint8_t *>(&closed), sizeof(RollupDay));
+    rollupCount++;
+    rollupUnsent = min(rollupUnsent + 1, (int)rollupCount);
+    uint8_t position[3] = {rollupHead, rollupCount, rollupUnsent};   // Head, count and unsent are next to each other - one write
+    FRAMwriteBlock(FRAM::rollupHeadAddr, position, sizeof(position));
+
+    rollupOpen(now);
+}
+
+int rollupSummary(int index, char *text, size_t size)   // Daily publish for a day in the ring with the 7 and 30 days to it - returns the length
+{
+    RollupDay day, earlier;
+    if (!rollupPeek(index, day)) return 0;
+    unsigned long week = 0, month = 0;
+    int weekDays = 0, monthDays = 0;
+    for (int i = index; i >= 0 && rollupPeek(i, earlier) && day.day - earlier.day < 30; i--) {
+        month += earlier.total;
+        monthDays++;
+        if (day.day - earlier.day < 7) {
+            week += earlier.total;
+            weekDays++;
+        }
+    }
+    time_t noon = (time_t)day.day * 86400 + 43200 - (long)(Time.zone() * 3600);   // Midday local keeps the date clear of the zone offset
+    TextBuffer summary(text, size);
+    summary.format("{\"date\":\"%04i-%02i-%02i\",\"total\":%u,\"peakHr\":%u,\"peakHrCnt\":%u,\"busyMin\":\"%02u:%02u\",\"busyMinCnt\":%u,",
+        Time.year(noon), Time.month(noon), Time.day(noon), day.total, day.peakHour, day.peakHourCount,
+        day.busiestMinute / 60, day.busiestMinute % 60, day.busiestMinuteCount);
+    summary.format("\"gapP25\":%u,\"gapP50\":%u,\"gapP90\":%u,\"alerts\":%u,\"wk\":%lu,\"wkDays\":%i,\"mo\":%lu,\"moDays\":%i}",
+        day.gapP25, day.gapP50, day.gapP90, day.alerts, week, weekDays, month, monthDays);
+    return summary.length();
+}
+
+void rollupSent()                                   // The oldest unsent day was published
+{
+    if (!rollupUnsent) return;
+    rollupUnsent--;
+    FRAMwrite8(FRAM::rollupUnsentAddr, rollupUnsent);
+}
@@ -0,0 +1,192 @@
+// Data Usage Header File
+// Keeps track of the cellular data we use so a capped SIM plan is not overrun. Every publish, webhook response,
+// collector datagram, function call and variable read is counted where it happens - the payload plus an estimate of
+// the DTLS / CoAP or UDP / IP overhead - and each cloud session adds an estimate for the handshake and keep-alives.
+// The modem's own counters are read when it is about to be turned off so the estimate can be checked against them.
+// Totals are kept in FRAM for the day and the month. With a monthly budget set, operation steps down as it is used
+// up: no verbose logging, then batched reports with the log and daily summaries held, then one report a day.
+
+const unsigned long usagePublishOverhead = 90;      // DTLS record, CoAP header and the ack for each publish - an estimate
+const unsigned long usageReceiveOverhead = 90;      // The same for a function call, variable read or webhook response
+const unsigned long usageDatagramOverhead = 28;     // IP and UDP headers on each collector datagram
+const unsigned long usageSessionBytes = 800;        // Resumed DTLS session, hello, time sync and subscription - a full handshake is several KB but rare
+const unsigned long usageKeepAliveBytes = 120;      // One ping and its ack
+const unsigned long usageKeepAliveMs = 23 * 60000UL;    // Device OS keep-alive on the Electron
+const int usageBatchHours = 3;                      // Report every few hours once the budget is nearly gone
+
+enum UsageCategory { USAGE_REPORT, USAGE_LOG, USAGE_EVENTS, USAGE_CLOUD_IN, USAGE_SESSION, USAGE_CATEGORY_COUNT };
+const char* usageCategoryNames[USAGE_CATEGORY_COUNT] = {"rpt", "log", "evt", "in", "ses"};
+enum UsageLevel { USAGE_NORMAL, USAGE_COMPACT, USAGE_BATCHED, USAGE_DAILY };   // How far operation has been cut back
+
+struct __attribute__((packed)) UsageMeter {         // 45 bytes in FRAM
+    uint16_t day;                                   // Local day the day totals are for
+    uint8_t month;                                  // Month the month totals are for - 1 to 12
+    uint16_t sessions;                              // Cloud sessions today
+    uint32_t dayBytes;                              // Estimated bytes today and this month
+    uint32_t monthBytes;
+    uint32_t categoryBytes[USAGE_CATEGORY_COUNT];   // Today's estimate by where it went
+    uint32_t modemDay;                              // Bytes the modem counted today and this month
+    uint32_t modemMonth;
+    uint32_t modemLast;                             // Last modem reading - its counters start over when it is powered off
+};
+
+UsageMeter usage;
+int usageBudgetKB;                                  // Monthly budget in KB - 0 is no budget - loaded from FRAM by the sketch
+int usageLevel = USAGE_NORMAL;
+volatile uint32_t usageVariableBytes = 0;           // Variable reads can come in on the system thread - added to the meter by usageTrack()
+                                                    // Only changed inside ATOMIC_BLOCK() - volatile alone does not make += atomic
+
+uint16_t usageLocalDay(time_t t)
+{
+    return (t + (long)(Time.zone() * 3600)) / 86400;
+}
+
+void usageSave()
+{
+    FRAMwriteBlock(FRAM::usageMeterAddr, reinterpret_cast<const uint8_t *>(&usage), sizeof(usage));
+}
+
+void usageCount(int category, unsigned long bytes)  // RAM only - saved hourly and before the RAM is lost
+{
+    usage.categoryBytes[category] += bytes;
+    usage.dayBytes += bytes;
+    usage.monthBytes += bytes;
+}
+
+unsigned long usagePublishBytes(const char *event, const char *data)
+{
+    return usagePublishOverhead + strlen(event) + (data ? strlen(data) : 0);
+}
+
+void usageVariableRead(unsigned long length)        // Call from a variable callback - it may be on the system thread
+{
+    ATOMIC_BLOCK() {
+        usageVariableBytes += usageReceiveOverhead + length;
+    }
+}
+
+bool usagePublish(const char *event, const char *data, int category)    // Particle.publish() with the bytes counted
+{
+    usageCount(category, usagePublishBytes(event, data));
+    return Particle.publish(event, data);
+}
+
+template <typename Flags>
+bool usagePublish(const char *event, const char *data, Flags flags, int category)
+{
+    usageCount(category, usagePublishBytes(event, data));
+    return Particle.publish(event, data, flags);
+}
+
+template <int (*handler)(String)>
+int usageFunction(String command)                   // Register as Particle.function(name, usageFunction<handler>) to count the call
+{
+    usageCount(USAGE_CLOUD_IN, usageReceiveOverhead + command.length());
+    return handler(command);
+}
+
+unsigned long usageUsed()                           // The month so far - the modem's count if it saw more than we estimated
+{
+    return max(usage.monthBytes, usage.modemMonth);
+}
+
+int usageLevelFor()
+{
+    if (!usageBudgetKB) return USAGE_NORMAL;
+    unsigned long budget = usageBudgetKB * 1024UL;
+    unsigned long used = usageUsed();
+    if (used >= budget) return USAGE_DAILY;
+    if (used >= budget / 10 * 9) return USAGE_BATCHED;
+    if (used >= budget / 4 * 3) return USAGE_COMPACT;
+    if (max(usage.dayBytes, usage.modemDay) > budget / 15) return USAGE_COMPACT;   // Twice a 30 day share - rein in today
+    return USAGE_NORMAL;
+}
+
+int usageReportHours()                              // Hours between reports at the current level
+{
+    if (usageLevel >= USAGE_DAILY) return 24;
+    if (usageLevel >= USAGE_BATCHED) return usageBatchHours;
+    return 1;
+}
+
+void usageRoll(time_t now)                          // Start new day and month totals when the local date changes
+{
+    uint16_t today = usageLocalDay(now);
+    if (usage.day == today) return;
+    uint8_t month = Time.month(now);
+    if (usage.month != month) {
+        usage.month = month;
+        usage.monthBytes = usage.modemMonth = 0;
+    }
+    usage.day = today;
+    usage.sessions = 0;
+    usage.dayBytes = usage.modemDay = 0;
+    memset(usage.categoryBytes, 0, sizeof(usage.categoryBytes));
+}
+
+void usageBegin()
+{
+    FRAMreadBlock(FRAM::usageMeterAddr, reinterpret_cast<uint8_t *>(&usage), sizeof(usage));
+    if (usage.month < 1 || usage.month > 12) memset(&usage, 0, sizeof(usage));    // Not written by us - start from nothing
+    usageRoll(Time.now());
+    usageLevel = usageLevelFor();
+}
+
+void usageModem()                                   // Adds what the modem counted since the last reading - call before it is turned off
+{
+    CellularData data;
+    if (!Cellular.ready() || !Cellular.getDataUsage(data)) return;
+    uint32_t total = data.tx_total + data.rx_total;
+    if (total < usage.modemLast) usage.modemLast = 0;   // Power cycled since the last reading
+    usage.modemDay += total - usage.modemLast;
+    usage.modemMonth += total - usage.modemLast;
+    usage.modemLast = total;
+}
+
+bool usageTrack()                                   // Call each loop - returns true if the level changed
+{
+    static bool connected = false;
+    static unsigned long lastKeepAlive = 0;
+    if (Particle.connected()) {
+        if (!connected) {                           // A new session
+            usage.sessions++;
+            usageCount(USAGE_SESSION, usageSessionBytes);
+            lastKeepAlive = millis();
+        }
+        else if (millis() - lastKeepAlive >= usageKeepAliveMs) {
+            usageCount(USAGE_SESSION, usageKeepAliveBytes);
+            lastKeepAlive += usageKeepAliveMs;
+        }
+        connected = true;
+    }
+    else connected = false;
+    uint32_t bytes;
+    ATOMIC_BLOCK() {
+        bytes = usageVariableBytes;
+        usageVariableBytes = 0;
+    }
+    if (bytes) usageCount(USAGE_CLOUD_IN, bytes);
+    usageRoll(Time.now());
+    int level = usageLevelFor();
+    if (level == usageLevel) return false;
+    usageLevel = level;
+    return true;
+}
+
+int usagePercent()                                  // Of the monthly budget - 0 with no budget
+{
+    return usageBudgetKB ? min(usageUsed() / 1024 * 100 / usageBudgetKB, 999UL) : 0;
+}
+
+String usageSnapshot()                              // Backs the DataUsage variable
+{
+    static char data[256];
+    TextBuffer text(data, sizeof(data));
+    text.format("{\"day\":%lu,\"month\":%lu,\"modemDay\":%lu,\"modemMonth\":%lu,\"budgetKB\":%i,\"pct\":%i,\"level\":%i,\"sessions\":%u",
+        (unsigned long)usage.dayBytes, (unsigned long)usage.monthBytes, (unsigned long)usage.modemDay, (unsigned long)usage.modemMonth,
+        usageBudgetKB, usagePercent(), usageLevel, usage.sessions);
+    for (int i = 0; i < USAGE_CATEGORY_COUNT; i++) text.format(",\"%s\":%lu", usageCategoryNames[i], (unsigned long)usage.categoryBytes[i]);
+    text.add('}');
+    usageVariableRead(text.length());
+    return String(data);
+}
@@ -0,0 +1,113 @@
+// Diagnostic Log Header File
+// Leveled log of compact records - kept in a RAM ring, spilled to a ring in FRAM and sent in batches by flushLog()
+// so verbose mode does not need a publish (and a wait) for every event. The FRAM ring survives deep sleep and resets.
+
+enum LogLevel { LOG_ERROR, LOG_WARN, LOG_INFO, LOG_DEBUG };
+enum LogCode { LOG_STATE, LOG_COUNT, LOG_DEBOUNCED, LOG_BURST, LOG_DEBOUNCE_SET, LOG_LOW_POWER, LOG_WEBHOOK_OK,
+               LOG_WEBHOOK_ERROR, LOG_WEBHOOK_EMPTY, LOG_RESETTING, LOG_DEBOUNCE_LEARNED,
+               LOG_REPORT_DEFERRED, LOG_REPORT_FORCED, LOG_NAP_COUNTED,
+               LOG_REPORT_FAILED, LOG_RETRY_STEP, LOG_USAGE_LEVEL, LOG_WEBHOOK_STALE, LOG_CODE_COUNT };
+const char* logFormats[LOG_CODE_COUNT] = {"State %s>%s", "Car h:%i d:%i", "Debounced", "Burst %i held over %i", "Debounce %i dSec",
+    "Low power %i", "Webhook ok", "Webhook %i", "Webhook no data", "Resetting %i", "Learned %i mSec %i%%",
+    "Deferred q:%i for %i min", "Forced q:%i after %i min", "Nap counted %i h:%i",
+    "Report failed %i next %i min", "Retry step %i radio %i sec",
+    "Data level %i at %i%%", "Webhook %i for report %i ignored"};
+extern char stateNames[8][14];                      // From the sketch - state transitions are logged as state numbers
+
+struct __attribute__((packed)) LogRecord {          // 10 bytes in RAM and in FRAM
+    uint32_t time;                                  // Time.now() when logged
+    uint8_t level;
+    uint8_t code;
+    int16_t a;                                      // Arguments for the format string
+    int16_t b;
+};
+
+const int logRamSize = 32;                          // Records held in RAM before spilling to FRAM
+uint16_t logFramSize = 0;                           // Records in the FRAM ring - oldest are overwritten when full - sized by logBegin()
+LogRecord logRam[logRamSize];
+int logRamCount = 0;                                // RAM records are always newer than FRAM records
+uint16_t logFramHead = 0;                           // Index of the oldest FRAM record
+uint16_t logFramCount = 0;
+uint16_t logDropped = 0;                            // Records overwritten before they were sent
+int logLevel = LOG_WARN;                            // Records above this level are not kept
+
+void logBegin()                                     // Size the FRAM ring from the FRAM we found and reload its position
+{
+    logFramSize = min((unsigned long)(fram.size() - FRAM::logRecordsAddr) / sizeof(LogRecord), 0xFFFFUL);
+    logFramHead = FRAMread16(FRAM::logHeadAddr);
+    logFramCount = FRAMread16(FRAM::logCountAddr);
+    if (logFramHead >= logFramSize || logFramCount > logFramSize) logFramHead = logFramCount = 0;
+}
+
+void logSpill()                                     // Move the RAM records to FRAM - call before anything that loses RAM
+{
+    if (!logRamCount) return;
+    for (int i = 0; i < logRamCount; i++) {
+        if (logFramCount == logFramSize) {          // Full - drop the oldest
+            logFramHead = (logFramHead + 1) % logFramSize;
+            logFramCount--;
+            logDropped++;
+        }
+        int slot = (logFramHead + logFramCount) % logFramSize;
+        FRAMwriteBlock(FRAM::logRecordsAddr + slot * sizeof(LogRecord), reinterpret_cast<const uint8_t *>(&logRam[i]), sizeof(LogRecord));
+        logFramCount++;
+    }
+    logRamCount = 0;
+    FRAMwrite16(FRAM::logHeadAddr, logFramHead);
+    FRAMwrite16(FRAM::logCountAddr, logFramCount);
+}
+
+void logEvent(int level, int code, int a = 0, int b = 0)
+{
+    if (level > logLevel) return;
+    if (logRamCount == logRamSize) logSpill();
+    LogRecord &record = logRam[logRamCount++];
+    record.time = Time.now();
+    record.level = level;
+    record.code = code;
+    record.a = a;
+    record.b = b;
+}
+
+int logPending()
+{
+    return logFramCount + logRamCount;
+}
+
+bool logPeek(int index, LogRecord &record)          // index 0 is the oldest record
+{
+    if (index >= logPending()) return false;
+    if (index < logFramCount) {
+        int slot = (logFramHead + index) % logFramSize;
+        FRAMreadBlock(FRAM::logRecordsAddr + slot * sizeof(LogRecord), reinterpret_cast<uint8_t *>(&record), sizeof(LogRecord));
+    }
+    else record = logRam[index - logFramCount];
+    return true;
+}
+
+void logPop(int count)                              // Drop the oldest records once they have been sent
+{
+    int fromFram = min(count, (int)logFramCount);
+    if (fromFram) {
+        logFramHead = (logFramHead + fromFram) % logFramSize;
+        logFramCount -= fromFram;
+        FRAMwrite16(FRAM::logHeadAddr, logFramHead);
+        FRAMwrite16(FRAM::logCountAddr, logFramCount);
+    }
+    int fromRam = min(count - fromFram, logRamCount);
+    if (fromRam) {
+        memmove(logRam, logRam + fromRam, (logRamCount - fromRam) * sizeof(LogRecord));
+        logRamCount -= fromRam;
+    }
+}
+
+int logFormat(const LogRecord &record, char *line, size_t size)     // "hh:mm:ss text" - returns the length
+{
+    const char *levels = "EWID";
+    TextBuffer text(line, size);
+    text.format("%02i:%02i:%02i %c ", Time.hour(record.time), Time.minute(record.time), Time.second(record.time), levels[record.level & 3]);
+    if (record.code >= LOG_CODE_COUNT) return text.length();
+    if (record.code == LOG_STATE) text.format(logFormats[record.code], stateNames[record.a & 7], stateNames[record.b & 7]);
+    else text.format(logFormats[record.code], record.a, record.b);
+    return text.length();
+}
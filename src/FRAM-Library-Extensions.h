@@ -5,6 +5,7 @@ Adafruit_FRAM_I2C fram = Adafruit_FRAM_I2C(); // Init the FRAM
 // Begin section
 uint8_t FRAMread8(unsigned int address)  // Read 8 bits from FRAM
 {
+    PROFILE_PHASE(PHASE_FRAM_IO);
     uint8_t result;
     result = fram.read8(address);
     return result;
@@ -12,11 +13,13 @@ uint8_t FRAMread8(unsigned int address)  // Read 8 bits from FRAM
 
 void FRAMwrite8(unsigned int address, uint8_t value)    // Write 8 bits to FRAM
 {
+    PROFILE_PHASE(PHASE_FRAM_IO);
     fram.write8(address,value);
 }
 
 int FRAMread16(unsigned int address)
 {
+    PROFILE_PHASE(PHASE_FRAM_IO);
     long two;
     long one;
     //Read the 2 bytes from  memory.
@@ -28,6 +31,7 @@ int FRAMread16(unsigned int address)
 
 void FRAMwrite16(unsigned int address, int value)   // Write 16 bits to FRAM
 {
+    PROFILE_PHASE(PHASE_FRAM_IO);
     //This function will write a 2 uint8_t (16bit) long to the eeprom at
     //the specified address to address + 1.
     //Decomposition from a long to 2 bytes by using bitshift.
@@ -41,6 +45,7 @@ void FRAMwrite16(unsigned int address, int value)   // Write 16 bits to FRAM
 
 unsigned long FRAMread32(unsigned long address)
 {
+    PROFILE_PHASE(PHASE_FRAM_IO);
     long four;
     long three;
     long two;
@@ -56,6 +61,7 @@ unsigned long FRAMread32(unsigned long address)
 
 void FRAMwrite32(int address, unsigned long value)  // Write 32 bits to FRAM
 {
+    PROFILE_PHASE(PHASE_FRAM_IO);
     //This function will write a 4 uint8_t (32bit) long to the eeprom at
     //the specified address to address + 3.
     //Decomposition from a long to 4 bytes by using bitshift.
@@ -71,23 +77,43 @@ void FRAMwrite32(int address, unsigned long value)  // Write 32 bits to FRAM
     fram.write8(address + 3, one);
 }
 
+void FRAMreadBlock(unsigned int address, uint8_t *values, size_t count)    // Burst read - one I2C transaction per Wire buffer
+{
+    PROFILE_PHASE(PHASE_FRAM_IO);
+    fram.read(address, values, count);
+}
+
+void FRAMwriteBlock(unsigned int address, const uint8_t *values, size_t count)   // Burst write - lets us commit a group of values together
+{
+    PROFILE_PHASE(PHASE_FRAM_IO);
+    fram.write(address, values, count);
+}
+
 
 void ResetFRAM()  // This will reset the FRAM - set the version and preserve delay and sensitivity
 {
-    // Note - have to hard code the size here due to this issue - http://www.microchip.com/forums/m501193.aspx
+    // Size comes from the chips fram.begin() found - one block write per Wire buffer rather than a transaction per byte
+    const uint8_t zeros[MB85RC_WIRE_BUFFER - 2] = {0};
+    const char* progress[4] = {"Fram Reset 1/4 done", "Fram Reset 1/2 done", "Fram Reset 3/4 done", "Fram Reset done"};
+    unsigned long size = fram.size();
+    unsigned long quarter = 1;
     byte tempControlReg = FRAMread8(FRAM::controlRegisterAddr);
     if (Particle.connected()) Particle.publish("FRAM","Resetting in progress");
-    for (unsigned long i=8; i < 32768; i++) {  // Start at 4 to not overwrite debounce and sensitivity
-        FRAMwrite8(i,0x0);
-        if (i==8192) if (Particle.connected()) Particle.publish("Event", "Fram Reset 1/4 done");
-        if (i==16384) if (Particle.connected()) Particle.publish("Event", "Fram Reset 1/2 done");
-        if (i==(24576)) if (Particle.connected()) Particle.publish("Event", "Fram Reset 3/4 done");
-        if (i==32767) if (Particle.connected()) Particle.publish("Event", "Fram Reset done");
+    for (unsigned long i=8; i < size; i += sizeof(zeros)) {  // Start at 8 to not overwrite debounce and sensitivity
+        FRAMwriteBlock(i, zeros, min((unsigned long)sizeof(zeros), size - i));
+        if (i + sizeof(zeros) >= size * quarter / 4) {
+            if (Particle.connected()) Particle.publish("Event", progress[quarter - 1]);
+            quarter++;
+        }
     }
     FRAMwrite8(FRAM::controlRegisterAddr,tempControlReg);   // Preserce the control register values
     FRAMwrite8(FRAM::versionAddr,versionNumber);  // Reset version to match #define value for sketch
     FRAMwrite8(FRAM::openTimeAddr,0);                               // These set the defaults if the FRAM is erased
     FRAMwrite8(FRAM::closeTimeAddr,23);                             // This will ensure the device does not sleep
     FRAMwrite8(FRAM::debounceAddr,10);                               // Sets a default debounce of 1 Sec
+    FRAMwrite8(FRAM::jitterWindowAddr,10);                           // Spread reports over the first 10 minutes of the hour
+    FRAMwrite8(FRAM::minSignalAddr,20);                              // Reports wait for 20% signal quality
+    FRAMwrite8(FRAM::maxStaleAddr,3);                                // but no more than 3 hours
+    FRAMwrite8(FRAM::retryCapAddr,30);                               // Failed reports may use 30 minutes of radio a day
 
 }
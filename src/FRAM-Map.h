@@ -0,0 +1,61 @@
+// FRAM Map Header File
+// Where everything lives in the FRAM - shared by the sketch and the host tools in tools/fram-emulator so the tools
+// can't drift from the map the sketch really uses.
+
+namespace FRAM {                                    // Moved to namespace instead of #define to limit scope
+  enum Addresses {
+    versionAddr           = 0x0,                    // Where we store the memory map version number
+    debounceAddr          = 0x2,                    // Where we store debounce in dSec or 1/10s of a sec (ie 1.6sec is stored as 16)
+    resetCountAddr        = 0x3,                    // This is where we keep track of how often the Electron was reset
+    timeZoneAddr          = 0x4,                    // Store the local time zone data
+    openTimeAddr          = 0x5,                    // Hour for opening the park / store / etc - military time (e.g. 6 is 6am)
+    closeTimeAddr         = 0x6,                    // Hour for closing of the park / store / etc - military time (e.g 23 is 11pm)
+    controlRegisterAddr   = 0x7,                    // This is the control register for storing the current state
+    currentHourlyCountAddr =0x8,                    // Current Hourly Count - 16 bits
+    currentDailyCountAddr = 0xC,                    // Current Daily Count - 16 bits
+    currentCountsTimeAddr = 0xE,                    // Time of last count - 32 bits
+    alertsCountAddr       = 0x12,                   // Current Hour Alerts Count
+    maxMinLimitAddr       = 0x13,                   // Current value for MaxMin Limit
+    scheduleAddr          = 0x14,                   // Weekly schedule and closure dates - ParkSchedule block of 48 bytes
+    jitterWindowAddr      = 0x44,                   // Window in minutes after the hour that reports are spread over
+    debounceAutoAddr      = 0x45,                   // 1 if the learned debounce is used - otherwise the debounceAddr value
+    minSignalAddr         = 0x46,                   // Reports wait for at least this signal quality in percent - 0 never waits
+    maxStaleAddr          = 0x47,                   // Hours a report can be deferred before it is sent anyway
+    napCountingAddr       = 0x48,                   // 1 if naps count vehicles without waking up fully
+    retryCapAddr          = 0x49,                   // Minutes of radio time a day that failed reports may use
+    transportAddr         = 0x4A,                   // 0 reports go to the Particle webhook - 1 to the collector
+    collectorHostAddr     = 0x4B,                   // Collector IPv4 address - 4 bytes
+    collectorPortAddr     = 0x4F,                   // Collector UDP port - 16 bits
+    usageBudgetAddr       = 0x51,                   // Monthly data budget in KB - 16 bits - 0 is no budget - last of the config block
+    logHeadAddr           = 0x53,                   // Oldest record in the diagnostic log ring - 16 bits
+    logCountAddr          = 0x55,                   // Records in the diagnostic log ring - 16 bits
+    hourHeadAddr          = 0x57,                   // Oldest closed hour waiting to be reported
+    hourCountAddr         = 0x58,                   // Closed hours waiting to be reported
+    hourLastAddr          = 0x59,                   // UTC hour of the last hour closed - 32 bits - an hour is only closed once
+    hourBucketsAddr       = 0x5D,                   // Closed hours ring - 48 HourBucket records of 10 bytes (to 0x23C)
+                                                    // 0x23D - 0x54B free - was the diagnostic log ring
+    learnedDebounceAddr   = 0x54C,                  // Learned debounce in mSec - 16 bits
+    debounceConfidenceAddr = 0x54E,                 // Confidence in the learned debounce - percent
+    pulseHistogramsAddr   = 0x54F,                  // Pulse width and gap histograms - 96 bytes (to 0x5AE)
+                                                    // 0x5AF - 0x5B0 free
+    rollupTodayAddr       = 0x5B1,                  // The day so far - RollupToday block of 95 bytes (to 0x60F)
+    rollupHeadAddr        = 0x610,                  // Oldest day in the daily rollup ring
+    rollupCountAddr       = 0x611,                  // Days in the daily rollup ring
+    rollupUnsentAddr      = 0x612,                  // Newest days not yet published
+    rollupDaysAddr        = 0x613,                  // Daily rollup ring - 30 RollupDay records of 17 bytes (to 0x810)
+                                                    // 0x811 free
+    napPulsesAddr         = 0x812,                  // Vehicles counted in the current nap - 16 bits
+    retryStateAddr        = 0x814,                  // Backoff and escalation for failed reports - RetryState block of 11 bytes (to 0x81E)
+                                                    // 0x81F - 0x826 free
+    usageMeterAddr        = 0x827,                  // Cellular data used today and this month - UsageMeter block of 45 bytes (to 0x853)
+                                                    // 0x854 - 0x855 free
+    burstBucketsAddr      = 0x856,                  // Counts in a minute baseline for each hour - 24 BurstBucket records of 5 bytes (to 0x8CD)
+    hourlyQuarantineAddr  = 0x8CE,                  // Suspect counts held apart this hour - 16 bits
+    dailyQuarantineAddr   = 0x8D0,                  // Suspect counts today - 16 bits
+                                                    // 0x8D2 - 0x8FF free
+    logRecordsAddr        = 0x900,                  // Diagnostic log ring - 10 byte records to the end of the FRAM - keep last
+  };
+};
+
+const int configBlockSize = FRAM::usageBudgetAddr + 2 - FRAM::debounceAddr;  // debounceAddr to usageBudgetAddr - setConfig() writes it in one go
+const int versionNumber = 24;                       // Increment this number each time the memory map is changed
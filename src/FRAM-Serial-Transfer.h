@@ -0,0 +1,138 @@
+// FRAM Serial Transfer Header File
+// Dumps and restores the FRAM over USB serial - lets us recover a unit whose cellular link is dead.
+// Commands are text lines from the host, data moves in binary frames:
+//   D <start> <length>  or  D <region>     Dump - replies "DUMP <start> <length>", the frames, then "END <crc>"
+//   R <start> <length>                     Restore - replies "READY", then "ACK <addr>" or "NAK <addr>" for each frame
+//                                          and "DONE <crc>" once the whole range reads back correctly ("FAIL" if not)
+//   I                                      Info - replies "INFO <size> <version> <chips>"
+// Frame: 0xA5, address (3 bytes, high first), length (1 byte), data, CRC-16/CCITT of everything before it (2 bytes, high first)
+// Regions: all, config, schedule, log, logrecords - see FRAM::Addresses. A restored image is only loaded after a reset.
+
+const uint8_t transferFrameStart = 0xA5;
+const int transferFrameData = 64;                   // Data bytes per frame - two burst reads from the FRAM
+
+uint16_t transferCRC(const uint8_t *data, size_t length, uint16_t crc = 0xFFFF)   // CRC-16/CCITT
+{
+    while (length--) {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (int bit = 0; bit < 8; bit++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+bool transferRegion(const char *name, unsigned long *start, unsigned long *length)
+{
+    if (!strcmp(name, "all")) { *start = 0; *length = fram.size(); }
+    else if (!strcmp(name, "config")) { *start = FRAM::versionAddr; *length = FRAM::scheduleAddr; }
+    else if (!strcmp(name, "schedule")) { *start = FRAM::scheduleAddr; *length = sizeof(ParkSchedule); }
+    else if (!strcmp(name, "log")) { *start = FRAM::logHeadAddr; *length = FRAM::logCountAddr + 2 - FRAM::logHeadAddr; }   // Ring position
+    else if (!strcmp(name, "logrecords")) { *start = FRAM::logRecordsAddr; *length = logFramSize * sizeof(LogRecord); }
+    else return false;
+    return true;
+}
+
+void transferDump(unsigned long start, unsigned long length)
+{
+    uint8_t frame[1 + 3 + 1 + transferFrameData + 2];
+    uint16_t imageCRC = 0xFFFF;
+    Serial.printlnf("DUMP %lu %lu", start, length);
+    for (unsigned long addr = start; addr < start + length; addr += transferFrameData) {
+        int count = min((unsigned long)transferFrameData, start + length - addr);
+        frame[0] = transferFrameStart;
+        frame[1] = addr >> 16;
+        frame[2] = addr >> 8;
+        frame[3] = addr;
+        frame[4] = count;
+        FRAMreadBlock(addr, frame + 5, count);
+        uint16_t crc = transferCRC(frame, 5 + count);
+        frame[5 + count] = crc >> 8;
+        frame[6 + count] = crc & 0xFF;
+        Serial.write(frame, 7 + count);
+        imageCRC = transferCRC(frame + 5, count, imageCRC);
+    }
+    Serial.printlnf("END %04X", imageCRC);
+}
+
+void transferRestore(unsigned long start, unsigned long length)
+{
+    uint8_t frame[1 + 3 + 1 + transferFrameData + 2];
+    uint8_t readBack[transferFrameData];
+    Serial.setTimeout(5000);
+    Serial.println("READY");
+    unsigned long received = 0;
+    while (received < length) {
+        if (Serial.readBytes(reinterpret_cast<char *>(frame), 5) != 5 || frame[0] != transferFrameStart) {
+            Serial.println("FAIL timeout");                 // Lost sync - the host has to start over
+            return;
+        }
+        unsigned long addr = ((unsigned long)frame[1] << 16) | (frame[2] << 8) | frame[3];
+        int count = frame[4];
+        if (count > transferFrameData || Serial.readBytes(reinterpret_cast<char *>(frame + 5), count + 2) != (size_t)(count + 2)) {
+            Serial.println("FAIL frame");
+            return;
+        }
+        uint16_t crc = transferCRC(frame, 5 + count);
+        if (frame[5 + count] != (crc >> 8) || frame[6 + count] != (crc & 0xFF) || addr < start || addr + count > start + length) {
+            Serial.printlnf("NAK %lu", addr);             // Host resends this frame
+            continue;
+        }
+        FRAMwriteBlock(addr, frame + 5, count);
+        FRAMreadBlock(addr, readBack, count);            // Verify before we acknowledge
+        if (memcmp(readBack, frame + 5, count)) {
+            Serial.printlnf("NAK %lu", addr);
+            continue;
+        }
+        Serial.printlnf("ACK %lu", addr);
+        received += count;
+    }
+    uint16_t imageCRC = 0xFFFF;                          // Read the whole range back so the host can compare it with its image
+    for (unsigned long addr = start; addr < start + length; addr += transferFrameData) {
+        int count = min((unsigned long)transferFrameData, start + length - addr);
+        FRAMreadBlock(addr, readBack, count);
+        imageCRC = transferCRC(readBack, count, imageCRC);
+    }
+    Serial.printlnf("DONE %04X", imageCRC);
+}
+
+void transferCommand(char *line)                        // Called with each complete line from the host
+{
+    char *savePtr;
+    char *command = strtok_r(line, " ", &savePtr);
+    char *first = strtok_r(NULL, " ", &savePtr);
+    char *second = strtok_r(NULL, " ", &savePtr);
+    unsigned long start = 0, length = 0;
+    if (!command) return;
+    if (!strcmp(command, "I")) {
+        Serial.printlnf("INFO %lu %u %u", (unsigned long)fram.size(), FRAMread8(FRAM::versionAddr), fram.chips());
+        return;
+    }
+    if (first && second) {
+        start = strtoul(first, NULL, 0);
+        length = strtoul(second, NULL, 0);
+    }
+    else if (!first || !transferRegion(first, &start, &length)) {
+        Serial.println("ERR usage");
+        return;
+    }
+    if (start >= fram.size() || length == 0 || length > fram.size() - start) Serial.println("ERR range");   // No start + length - it wraps
+    else if (!strcmp(command, "D")) transferDump(start, length);
+    else if (!strcmp(command, "R")) transferRestore(start, length);
+    else Serial.println("ERR command");
+}
+
+void serialTransfer()                                   // Call from loop() - collects a command line without blocking
+{
+    static char line[40];
+    static int length = 0;
+    while (Serial.available()) {
+        char c = Serial.read();
+        if (c == '\r') continue;
+        if (c == '\n') {
+            line[length] = '\0';
+            length = 0;
+            transferCommand(line);
+            return;
+        }
+        if (length < (int)sizeof(line) - 1) line[length++] = c;
+    }
+}
@@ -0,0 +1,83 @@
+// Hour Buckets Header File
+// Closed hours waiting to be reported. Each hour's counts are kept under its UTC hour number - Time.now() / 3600 -
+// and every report carries that key, so the back office keeps one value per device and hour and a report sent
+// again after a lost ack, a timeout or a reset changes nothing. A bucket only leaves the FRAM ring once a report of
+// it is acked - nothing is subtracted on a guess and nothing is lost if the answer never comes. The last hour closed is
+// kept with the ring so an hour is never closed twice - a second bucket under the same key, pushed by setup() after a
+// reset, would replace the hour's real count in the back office.
+
+const int hourBucketSlots = 48;                     // Two days of hours can wait out a long outage
+
+struct __attribute__((packed)) HourBucket {         // 10 bytes in the FRAM ring
+    uint32_t hour;                                  // UTC hours since 1970 - the key
+    uint16_t count;
+    uint16_t quarantine;                            // Suspect counts held apart by the burst detector
+    uint16_t daily;                                 // The day's count at the end of the hour
+};
+
+uint8_t hourHead = 0;                               // Oldest unsent hour in the ring
+uint8_t hourCount = 0;                              // Unsent hours in the ring
+uint32_t hourLast = 0;                              // Key of the last hour closed - acked or not
+uint16_t hourDropped = 0;                           // Since start-up - the oldest hour is overwritten when the ring is full
+
+void hourSavePosition()
+{
+    uint8_t position[6] = {hourHead, hourCount};    // Head, count and last hour are next to each other - one write
+    memcpy(position + 2, &hourLast, sizeof(hourLast));  // After the count - a cut between them is put right by hourBegin()
+    FRAMwriteBlock(FRAM::hourHeadAddr, position, sizeof(position));
+}
+
+bool hourPeek(int index, HourBucket &bucket)        // index 0 is the oldest unsent hour
+{
+    if (index < 0 || index >= hourCount) return false;
+    int slot = (hourHead + index) % hourBucketSlots;
+    FRAMreadBlock(FRAM::hourBucketsAddr + slot * sizeof(HourBucket), reinterpret_cast<uint8_t *>(&bucket), sizeof(HourBucket));
+    return true;
+}
+
+void hourBegin()
+{
+    hourHead = FRAMread8(FRAM::hourHeadAddr);
+    hourCount = FRAMread8(FRAM::hourCountAddr);
+    hourLast = FRAMread32(FRAM::hourLastAddr);
+    if (hourHead >= hourBucketSlots || hourCount > hourBucketSlots) hourHead = hourCount = 0;
+    HourBucket newest;                              // Cut off between the count and the last hour - the ring knows better
+    if (hourPeek(hourCount - 1, newest) && newest.hour > hourLast) hourLast = newest.hour;
+}
+
+bool hourPush(uint32_t hour, int count, int quarantine, int daily)   // False if the hour was closed already
+{
+    if (hour <= hourLast) return false;
+    HourBucket bucket = {hour, (uint16_t)constrain(count, 0, 0xFFFF), (uint16_t)constrain(quarantine, 0, 0xFFFF), (uint16_t)constrain(daily, 0, 0xFFFF)};
+    if (hourCount == hourBucketSlots) {             // Full - the oldest hour goes
+        hourHead = (hourHead + 1) % hourBucketSlots;
+        hourCount--;
+        hourDropped++;
+    }
+    int slot = (hourHead + hourCount) % hourBucketSlots;
+    FRAMwriteBlock(FRAM::hourBucketsAddr + slot * sizeof(HourBucket), reinterpret_cast<const uint8_t *>(&bucket), sizeof(HourBucket));
+    hourCount++;                                    // After the bucket is written - a reset in between loses nothing
+    hourLast = hour;
+    hourSavePosition();
+    return true;
+}
+
+bool hourClosed(time_t lastCount)                   // The saved counts are in the ring already - a reset came before they were zeroed
+{
+    return lastCount && (uint32_t)(lastCount / 3600) <= hourLast;
+}
+
+void hourAcked(uint32_t hour)                       // A report of this hour got through - drop it if it is still the oldest
+{
+    HourBucket oldest;
+    if (!hourPeek(0, oldest) || oldest.hour != hour) return;
+    hourHead = (hourHead + 1) % hourBucketSlots;
+    hourCount--;
+    hourSavePosition();
+}
+
+void hourClear()
+{
+    hourHead = hourCount = 0;
+    hourSavePosition();
+}
@@ -0,0 +1,37 @@
+// Park Schedule Header File
+// Weekly open / close hours and closure dates - stored in FRAM at FRAM::scheduleAddr exactly as laid out here
+
+const int maxHolidays = 16;                         // Closure dates we can hold
+
+struct ParkSchedule {
+    uint8_t enabled;                                // 0 - use openTime and closeTime every day
+    uint8_t weekly[7][2];                           // Open and close hour for each day - Sunday first - open of 24 is closed all day
+    uint8_t holidayCount;                           // Number of closure dates in use
+    uint8_t holidays[maxHolidays][2];               // Closure dates as month, day
+};
+
+const char* dayNames[7] = {"sun","mon","tue","wed","thu","fri","sat"};
+const uint8_t scheduleMonthDays[12] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};   // Feb 29 is allowed - it closes in leap years
+
+bool scheduleHoursValid(int open, int close)        // Open hour to close hour - both open, so the close has to come later
+{
+    if (open == 24) return true;                    // Closed all day
+    return open >= 0 && close <= 23 && open < close;    // 20-8 or 8-8 is a typo, not a way to close - use "closed"
+}
+
+bool scheduleDateValid(int month, int day)
+{
+    return month >= 1 && month <= 12 && day >= 1 && day <= scheduleMonthDays[month - 1];
+}
+
+bool scheduleValid(const ParkSchedule &candidate)   // Checks a schedule read from FRAM or built by setSchedule()
+{
+    if (candidate.enabled > 1 || candidate.holidayCount > maxHolidays) return false;
+    for (int day = 0; day < 7; day++) {
+        if (!scheduleHoursValid(candidate.weekly[day][0], candidate.weekly[day][1])) return false;
+    }
+    for (int i = 0; i < candidate.holidayCount; i++) {
+        if (!scheduleDateValid(candidate.holidays[i][0], candidate.holidays[i][1])) return false;
+    }
+    return true;
+}
@@ -0,0 +1,95 @@
+// Phase Profiler Header File
+// Times setup() and each loop() state with the Cortex-M3 DWT cycle counter and keeps min / max / mean and a
+// histogram per phase in RAM. Phases nest - a loop() state calls recordCount() which does FRAM I/O - and each is
+// charged only its own time, with the phases inside it taken out, so the totals add up to the time measured.
+// Application thread only. Compiles to nothing unless PHASE_PROFILING is defined before this file is included.
+
+#ifdef PHASE_PROFILING
+
+enum ProfilePhase {                                 // The loop state phases must stay in the same order as the State enum
+    PHASE_INITIALIZATION, PHASE_ERROR, PHASE_IDLE, PHASE_SLEEPING, PHASE_NAPPING, PHASE_LOW_BATTERY, PHASE_REPORTING, PHASE_RESP_WAIT,
+    PHASE_SETUP, PHASE_RECORD_COUNT, PHASE_FRAM_IO, PHASE_MEASUREMENTS, PHASE_PARTICLE_PROCESS, PHASE_COUNT
+};
+const char* phaseNames[PHASE_COUNT] = {"Initialize", "Error", "Idle", "Sleeping", "Napping", "Low Battery", "Reporting", "Response Wait",
+    "setup", "recordCount", "FRAM", "measure", "process"};
+
+const int profileBuckets = 16;                      // Bucket n holds durations from 2^(n-1) to 2^n microseconds - last one is everything longer
+
+struct PhaseStats {
+    uint32_t count;
+    uint32_t minMicros;
+    uint32_t maxMicros;
+    uint64_t totalMicros;
+    uint16_t histogram[profileBuckets];
+};
+PhaseStats phaseStats[PHASE_COUNT];
+unsigned long bootMillis = 0;                       // millis() when setup() started - time spent in Device OS before us
+
+void profilerBegin()                                // Call first thing in setup()
+{
+    bootMillis = millis();
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; // Enable the trace block so the cycle counter runs
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    memset(phaseStats, 0, sizeof(phaseStats));
+}
+
+void profilerRecord(int phase, uint32_t micros)
+{
+    PhaseStats &stats = phaseStats[phase];
+    if (stats.count == 0 || micros < stats.minMicros) stats.minMicros = micros;
+    if (micros > stats.maxMicros) stats.maxMicros = micros;
+    stats.totalMicros += micros;
+    stats.count++;
+    int bucket = micros ? 32 - __builtin_clz(micros) : 0;
+    if (bucket >= profileBuckets) bucket = profileBuckets - 1;
+    if (stats.histogram[bucket] < 0xFFFF) stats.histogram[bucket]++;
+}
+
+class ProfileScope;
+ProfileScope *profileInnermost = nullptr;           // The scope being timed now - its parent is the one it is nested in
+
+class ProfileScope {                                // Times from construction to the end of the enclosing scope
+ public:
+    ProfileScope(int phase) : _phase(phase), _startCycles(DWT->CYCCNT), _startMillis(millis()), _nestedMicros(0), _parent(profileInnermost) {
+        profileInnermost = this;
+    }
+    ~ProfileScope() {
+        uint32_t cycles = DWT->CYCCNT - _startCycles;
+        unsigned long elapsedMillis = millis() - _startMillis;
+        // The counter wraps after ~35 seconds at 120MHz - long phases (like waiting to connect) fall back to millis()
+        uint32_t micros = (elapsedMillis > 30000) ? elapsedMillis * 1000 : cycles / (SystemCoreClock / 1000000);
+        profilerRecord(_phase, micros > _nestedMicros ? micros - _nestedMicros : 0);   // Own time only
+        if (_parent) _parent->_nestedMicros += micros;
+        profileInnermost = _parent;
+    }
+ private:
+    int _phase;
+    uint32_t _startCycles;
+    unsigned long _startMillis;
+    uint32_t _nestedMicros;                         // Time spent in the phases inside this one
+    ProfileScope *_parent;
+};
+
+void profilerSummary(int phase, char *line, size_t size)    // One line per phase - times in microseconds
+{
+    const PhaseStats &stats = phaseStats[phase];
+    TextBuffer text(line, size);
+    text.format("%s n:%lu min:%lu mean:%lu max:%lu hist:", phaseNames[phase], (unsigned long)stats.count,
+        (unsigned long)stats.minMicros, stats.count ? (unsigned long)(stats.totalMicros / stats.count) : 0UL, (unsigned long)stats.maxMicros);
+    for (int i = 0; i < profileBuckets; i++) {
+        text.format(i ? ",%u" : "%u", stats.histogram[i]);
+    }
+}
+
+#define PROFILE_CONCAT2(a, b)        a##b
+#define PROFILE_CONCAT(a, b)         PROFILE_CONCAT2(a, b)
+#define PROFILE_BEGIN()              profilerBegin()
+#define PROFILE_PHASE(phase)         ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(phase)
+
+#else
+
+#define PROFILE_BEGIN()
+#define PROFILE_PHASE(phase)
+
+#endif
@@ -0,0 +1,200 @@
+// Report Transport Header File
+// How an hourly report gets to the back office. The Particle webhook path goes device -> Particle cloud -> webhook ->
+// Ubidots and the answer comes back on our response topic. The collector path sends the same report straight to a
+// collector host as one UDP datagram in a compact checksummed frame and waits for the collector's ack - resending
+// until it comes or the wait runs out. Both keep the same counters so the two can be compared in the field.
+
+enum TransportResult { TRANSPORT_WAITING, TRANSPORT_ACKED, TRANSPORT_FAILED };
+enum TransportKind { TRANSPORT_WEBHOOK, TRANSPORT_COLLECTOR, TRANSPORT_KIND_COUNT };
+const char* transportNames[TRANSPORT_KIND_COUNT] = {"webhook", "collector"};
+
+struct Report {                                     // One hourly report - each transport encodes it its own way
+    uint32_t sequence;                              // Matches the ack to the report
+    uint32_t hour;                                  // UTC hour the counts are for - the back office keeps one value per device and hour
+    uint32_t time;
+    int hourly;
+    int daily;
+    int quarantined;                                // Suspect counts held apart by the burst detector
+    int battery;
+    int temp;
+    int resets;
+    int alerts;
+    int maxmin;
+};
+
+struct TransportStats {                             // Since start-up
+    uint16_t sent;
+    uint16_t acked;
+    uint16_t failed;
+    uint32_t bytesOut;                              // Application bytes - the payload and what names it, not the cellular overhead
+    uint32_t bytesIn;
+    uint32_t latencyTotal;                          // mSec from send to ack summed over the acked reports
+    uint16_t latencyLast;
+};
+
+class ReportTransport {
+public:
+    virtual ~ReportTransport() {}
+    virtual bool send(const Report &report) = 0;    // False if the report could not be handed off
+    virtual TransportResult poll() = 0;             // Call each loop while waiting for the ack
+    TransportStats stats = {};
+
+protected:
+    uint32_t sequence = 0;
+    unsigned long sentAt = 0;
+    TransportResult result = TRANSPORT_ACKED;       // Nothing outstanding until the first send()
+
+    void started(uint32_t reportSequence, size_t bytes) {
+        sequence = reportSequence;
+        sentAt = millis();
+        result = TRANSPORT_WAITING;
+        stats.sent++;
+        stats.bytesOut += bytes;
+    }
+
+    void finished(TransportResult outcome) {
+        if (result != TRANSPORT_WAITING) return;    // Late or repeated answers change nothing
+        result = outcome;
+        if (outcome == TRANSPORT_ACKED) {
+            stats.acked++;
+            stats.latencyLast = min(millis() - sentAt, 0xFFFFUL);
+            stats.latencyTotal += stats.latencyLast;
+        }
+        else stats.failed++;
+    }
+};
+
+class WebhookTransport : public ReportTransport {   // Particle publish to the Ubidots webhook
+public:
+    bool send(const Report &report) override {
+        TextBuffer data(publishBuffer, sizeof(publishBuffer));
+        data.format("{\"seq\":%lu, \"hour\":%lu, \"timestamp\":%lu000, \"hourly\":%i, \"daily\":%i, \"quarantine\":%i, \"battery\":%i, \"temp\":%i, \"resets\":%i, \"alerts\":%i, \"maxmin\":%i}",
+            (unsigned long)report.sequence, (unsigned long)report.hour, (unsigned long)report.hour * 3600, report.hourly, report.daily, report.quarantined, report.battery, report.temp, report.resets, report.alerts, report.maxmin);
+        started(report.sequence, strlen(eventName) + data.length());
+        hour = report.hour;
+        if (usagePublish(eventName, data.c_str(), PRIVATE, USAGE_REPORT)) return true;
+        finished(TRANSPORT_FAILED);
+        return false;
+    }
+
+    TransportResult poll() override { return result; }
+
+    bool response(int code, uint32_t reportSequence, uint32_t reportHour, size_t bytes) {  // From the response topic handler - false if it is not for the report in flight
+        stats.bytesIn += bytes;
+        usageCount(USAGE_REPORT, usageReceiveOverhead + bytes);
+        if (reportSequence != sequence || reportHour != hour) return false;   // A late answer to an earlier report
+        finished((code == 200 || code == 201) ? TRANSPORT_ACKED : TRANSPORT_FAILED);
+        return true;
+    }
+
+private:
+    const char *eventName = "Ubidots-Car-Hook";
+    uint32_t hour = 0;                              // The response template echoes the sequence and hour back
+};
+
+const uint8_t collectorFrameStart = 0xC5;
+const uint8_t collectorReport = 0x01;
+const uint8_t collectorAck = 0x81;
+const int collectorReportSize = 39;                 // Start, type, device ID 12, sequence 4, hour 4, time 4, counts and health 11, CRC 2
+const int collectorAckSize = 9;                     // Start, type, sequence 4, status, CRC 2
+const unsigned long collectorResendMs = 5000;       // Resend the datagram until it is acked
+const uint16_t collectorLocalPort = 8632;           // The collector answers to where the datagram came from
+
+class CollectorTransport : public ReportTransport { // UDP datagram to a collector host
+public:
+    IPAddress host;
+    uint16_t port = 0;
+    uint8_t deviceID[12];                           // Binary form of System.deviceID()
+
+    void setDeviceID(const char *hex) {             // 24 hex digits
+        for (int i = 0; i < 24 && hex[i]; i++) {
+            int nibble = (hex[i] <= '9') ? hex[i] - '0' : (hex[i] | 0x20) - 'a' + 10;
+            deviceID[i / 2] = (i % 2) ? (deviceID[i / 2] | (nibble & 0xF)) : (nibble & 0xF) << 4;
+        }
+    }
+
+    bool send(const Report &report) override {
+        if (!host || !port) {                       // Not configured - fail now rather than wait out the ack
+            started(report.sequence, 0);
+            finished(TRANSPORT_FAILED);
+            return false;
+        }
+        uint8_t *f = frame;
+        *f++ = collectorFrameStart;
+        *f++ = collectorReport;
+        memcpy(f, deviceID, sizeof(deviceID));
+        f += sizeof(deviceID);
+        f = put32(f, report.sequence);
+        f = put32(f, report.hour);
+        f = put32(f, report.time);
+        f = put16(f, constrain(report.hourly, 0, 0xFFFF));
+        f = put16(f, constrain(report.daily, 0, 0xFFFF));
+        f = put16(f, constrain(report.quarantined, 0, 0xFFFF));
+        *f++ = constrain(report.battery, 0, 100);
+        *f++ = static_cast<int8_t>(constrain(report.temp, -128, 127));
+        *f++ = constrain(report.resets, 0, 255);
+        *f++ = constrain(report.alerts, 0, 255);
+        *f++ = constrain(report.maxmin, 0, 255);
+        put16(f, transferCRC(frame, collectorReportSize - 2));
+        udp.begin(collectorLocalPort);
+        started(report.sequence, 0);
+        if (transmit()) return true;
+        finished(TRANSPORT_FAILED);
+        return false;
+    }
+
+    TransportResult poll() override {
+        uint8_t ack[collectorAckSize + 1];
+        while (result == TRANSPORT_WAITING && udp.parsePacket() > 0) {
+            int length = udp.read(ack, sizeof(ack));
+            stats.bytesIn += max(length, 0);
+            usageCount(USAGE_REPORT, usageDatagramOverhead + max(length, 0));
+            if (length != collectorAckSize || ack[0] != collectorFrameStart || ack[1] != collectorAck) continue;
+            if (transferCRC(ack, collectorAckSize - 2) != get16(ack + collectorAckSize - 2)) continue;
+            if (get32(ack + 2) != sequence) continue;   // An ack for an earlier report
+            finished(ack[6] == 0 ? TRANSPORT_ACKED : TRANSPORT_FAILED);
+        }
+        if (result == TRANSPORT_WAITING && millis() - lastTransmit >= collectorResendMs) transmit();
+        if (result != TRANSPORT_WAITING) udp.stop();
+        return result;
+    }
+
+private:
+    UDP udp;
+    uint8_t frame[collectorReportSize];
+    unsigned long lastTransmit = 0;
+
+    bool transmit() {
+        lastTransmit = millis();
+        if (!udp.beginPacket(host, port)) return false;
+        udp.write(frame, collectorReportSize);
+        stats.bytesOut += collectorReportSize;
+        usageCount(USAGE_REPORT, usageDatagramOverhead + collectorReportSize);
+        return udp.endPacket() > 0;
+    }
+
+    static uint8_t *put16(uint8_t *p, uint16_t value) { *p++ = value >> 8; *p++ = value; return p; }
+    static uint8_t *put32(uint8_t *p, uint32_t value) { return put16(put16(p, value >> 16), value); }
+    static uint16_t get16(const uint8_t *p) { return (p[0] << 8) | p[1]; }
+    static uint32_t get32(const uint8_t *p) { return ((uint32_t)get16(p) << 16) | get16(p + 2); }
+};
+
+bool parseCollector(const TextSpan &span, uint8_t address[4], uint16_t &port)   // "10.0.0.5:8631"
+{
+    TextSpan host, portText, octet;
+    long value;
+    if (!splitAt(span, ':', host, portText) || !parseLong(portText, value) || value < 1 || value > 65535) return false;
+    port = value;
+    for (int i = 0; i < 4; i++) {
+        bool last = (i == 3);
+        if (last) octet = host;
+        else if (!splitAt(host, '.', octet, host)) return false;
+        if (!parseLong(octet, value) || value < 0 || value > 255) return false;
+        address[i] = value;
+    }
+    return true;
+}
+
+WebhookTransport webhookTransport;
+CollectorTransport collectorTransport;
+ReportTransport *transports[TRANSPORT_KIND_COUNT] = {&webhookTransport, &collectorTransport};
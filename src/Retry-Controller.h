@@ -0,0 +1,93 @@
+// Retry Controller Header File
+// What to do when a report does not get through. Each failure backs off exponentially with jitter - so a fleet
+// that lost the same tower does not come back in step - and climbs a ladder of stronger fixes: publish again,
+// reconnect to the cloud, power cycle the modem and finally reset. Radio time spent on failed attempts is capped
+// each day so a dead tower can't flatten the battery. The device goes back to counting between attempts and the
+// state is kept in FRAM so the backoff and the ladder carry on through a reset.
+
+enum RetryAction { RETRY_PUBLISH, RETRY_RECONNECT, RETRY_MODEM, RETRY_RESET, RETRY_ACTION_COUNT };
+const uint8_t retryAttemptsPerAction[RETRY_ACTION_COUNT] = {2, 2, 2, 1};    // Failures at each step before the next
+const unsigned long retryBaseSeconds = 60;          // First backoff - doubles with each failure
+const unsigned long retryMaxSeconds = 3600;         // Longest backoff
+
+struct __attribute__((packed)) RetryState {         // 11 bytes in FRAM
+    uint8_t failures;                               // Failed reports in a row - 0 once one gets through
+    uint8_t action;                                 // Step on the ladder for the next attempt
+    uint8_t attempts;                               // Failures at this step
+    uint16_t day;                                   // Local day the radio time below was spent on
+    uint32_t nextAt;                                // No attempt before this time - 0 if not backing off
+    uint16_t radioSeconds;                          // Radio time spent on failed attempts today
+};
+
+RetryState retryState;
+int retryCapMinutes;                                // Daily limit on radioSeconds - loaded from FRAM by the sketch
+
+uint16_t retryLocalDay(time_t t)
+{
+    return (t + (long)(Time.zone() * 3600)) / 86400;
+}
+
+void retrySave()
+{
+    FRAMwriteBlock(FRAM::retryStateAddr, reinterpret_cast<const uint8_t *>(&retryState), sizeof(retryState));
+}
+
+void retryBegin()
+{
+    FRAMreadBlock(FRAM::retryStateAddr, reinterpret_cast<uint8_t *>(&retryState), sizeof(retryState));
+    if (retryState.action >= RETRY_ACTION_COUNT || retryState.attempts > retryAttemptsPerAction[retryState.action]) {
+        memset(&retryState, 0, sizeof(retryState));    // Not written by us - start with no failures
+    }
+}
+
+void retrySucceeded()                               // A report got through - start the ladder again
+{
+    if (!retryState.failures && !retryState.nextAt) return;
+    retryState.failures = retryState.action = retryState.attempts = 0;
+    retryState.nextAt = 0;
+    retrySave();
+}
+
+void retryFailed(unsigned long radioSeconds, int ceiling)   // Backs off and steps up the ladder no higher than ceiling - retryState.nextAt is the next attempt
+{
+    time_t now = Time.now();
+    uint16_t today = retryLocalDay(now);
+    if (retryState.day != today) {                  // A new day - a new radio budget
+        retryState.day = today;
+        retryState.radioSeconds = 0;
+    }
+    retryState.radioSeconds = min(retryState.radioSeconds + radioSeconds, 0xFFFFUL);
+    if (retryState.failures < 0xFF) retryState.failures++;
+    if (++retryState.attempts >= retryAttemptsPerAction[retryState.action] && retryState.action < ceiling) {
+        retryState.action++;
+        retryState.attempts = 0;
+    }
+    if (retryState.action > ceiling) {              // An earlier failure climbed higher than this one needs
+        retryState.action = ceiling;
+        retryState.attempts = 0;
+    }
+    if (retryState.attempts > retryAttemptsPerAction[retryState.action]) {  // Held at the ceiling - stay a state retryBegin() accepts
+        retryState.attempts = retryAttemptsPerAction[retryState.action];
+    }
+
+    unsigned long backoff = min(retryBaseSeconds << min((int)retryState.failures - 1, 6), retryMaxSeconds);
+    retryState.nextAt = now + backoff / 2 + random(backoff / 2 + 1);    // Somewhere in the second half of the backoff
+    if (retryState.radioSeconds >= retryCapMinutes * 60UL) {           // Spent today's budget - wait for tomorrow
+        time_t tomorrow = now - (now + (long)(Time.zone() * 3600)) % 86400 + 86400;
+        retryState.nextAt = max((time_t)retryState.nextAt, tomorrow + (time_t)random(retryMaxSeconds));
+    }
+    retrySave();
+}
+
+void retryResetting()                              // Called just before the reset step - after the reset the ladder starts over
+{
+    retryState.action = RETRY_PUBLISH;
+    retryState.attempts = 0;
+    retryState.nextAt = Time.now();                 // Try as soon as we are back up
+    retrySave();
+}
+
+time_t retryNotBefore()                             // Reports are not due before this - 0 if we are not backing off
+{
+    return retryState.failures ? retryState.nextAt : 0;
+}
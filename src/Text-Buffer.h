@@ -0,0 +1,180 @@
+// Text Buffer Header File
+// Heap free parsing and formatting for the cloud functions and publishes. Device OS hands each function a String -
+// from there the command is only read in place through spans, and replies are built in fixed buffers with integer and
+// fixed point formatters, so a unit running for months never fragments its heap or pulls in the float printf code.
+
+#include <stdarg.h>
+
+class TextBuffer {                                  // Builds text in a caller's buffer - always terminated, truncates rather than overflow
+public:
+    TextBuffer(char *buffer, size_t size) : text(buffer), size(size), used(0) { text[0] = '\0'; }
+
+    TextBuffer &add(char c) {
+        if (used + 1 < size) {
+            text[used++] = c;
+            text[used] = '\0';
+        }
+        return *this;
+    }
+
+    TextBuffer &add(const char *string) {
+        while (*string && used + 1 < size) text[used++] = *string++;
+        text[used] = '\0';
+        return *this;
+    }
+
+    TextBuffer &addUnsigned(unsigned long value, int width = 0, char pad = ' ', int base = 10) {
+        char digits[12];
+        int count = 0;
+        do {
+            int digit = value % base;
+            digits[count++] = digit < 10 ? '0' + digit : 'A' + digit - 10;
+            value /= base;
+        } while (value);
+        while (width-- > count) add(pad);
+        while (count) add(digits[--count]);
+        return *this;
+    }
+
+    TextBuffer &addInt(long value, int width = 0, char pad = ' ') {
+        if (value >= 0) return addUnsigned(value, width, pad);
+        if (pad == '0') return add('-').addUnsigned(0UL - value, width - 1, pad);
+        char digits[12];                            // Space padding goes before the sign
+        TextBuffer number(digits, sizeof(digits));
+        number.add('-').addUnsigned(0UL - value);
+        while (width-- > number.length()) add(pad);
+        return add(digits);
+    }
+
+    TextBuffer &addFixed(long value, int decimals) {   // value is in units of 10^-decimals - addFixed(15, 1) adds "1.5"
+        unsigned long scale = 1;
+        for (int i = 0; i < decimals; i++) scale *= 10;
+        unsigned long magnitude = value < 0 ? 0UL - value : value;
+        if (value < 0) add('-');
+        addUnsigned(magnitude / scale);
+        if (decimals) add('.').addUnsigned(magnitude % scale, decimals, '0');
+        return *this;
+    }
+
+    TextBuffer &format(const char *format, ...) {   // printf subset - %i %d %u %x %X %s %c %% with l, 0 and width - no floats
+        va_list args;
+        va_start(args, format);
+        while (*format) {
+            if (*format != '%') {
+                add(*format++);
+                continue;
+            }
+            format++;
+            char pad = ' ';
+            int width = 0;
+            bool isLong = false;
+            if (*format == '0') pad = *format++;
+            while (*format >= '0' && *format <= '9') width = width * 10 + *format++ - '0';
+            if (*format == 'l') {
+                isLong = true;
+                format++;
+            }
+            switch (*format) {
+                case 'i':
+                case 'd': addInt(isLong ? va_arg(args, long) : va_arg(args, int), width, pad); break;
+                case 'u': addUnsigned(isLong ? va_arg(args, unsigned long) : va_arg(args, unsigned int), width, pad); break;
+                case 'x':
+                case 'X': addUnsigned(isLong ? va_arg(args, unsigned long) : va_arg(args, unsigned int), width, pad, 16); break;
+                case 's': add(va_arg(args, const char *)); break;
+                case 'c': add((char)va_arg(args, int)); break;
+                case '%': add('%'); break;
+                default: va_end(args); return *this;    // Unsupported - stop rather than misread the arguments
+            }
+            format++;
+        }
+        va_end(args);
+        return *this;
+    }
+
+    const char *c_str() const { return text; }
+    int length() const { return used; }
+
+private:
+    char *text;
+    size_t size;
+    size_t used;
+};
+
+char publishBuffer[256];                            // Shared by the publishes on the application thread - Particle.publish copies it
+
+struct TextSpan {                                   // Part of a string that is read in place - not terminated
+    const char *start;
+    const char *end;
+};
+
+TextSpan spanOf(const char *text)
+{
+    return TextSpan{text, text + strlen(text)};
+}
+
+bool spanIs(const TextSpan &span, const char *word) // Exactly equal
+{
+    size_t length = strlen(word);
+    return (size_t)(span.end - span.start) == length && !strncmp(span.start, word, length);
+}
+
+bool nextToken(TextSpan &rest, const char *separators, TextSpan &token)   // Takes the next token off rest - empty tokens are skipped
+{
+    while (rest.start < rest.end && strchr(separators, *rest.start)) rest.start++;
+    if (rest.start == rest.end) return false;
+    token.start = rest.start;
+    while (rest.start < rest.end && !strchr(separators, *rest.start)) rest.start++;
+    token.end = rest.start;
+    return true;
+}
+
+bool splitAt(const TextSpan &span, char separator, TextSpan &before, TextSpan &after)   // False if separator is not there
+{
+    for (const char *c = span.start; c < span.end; c++) {
+        if (*c == separator) {
+            before = TextSpan{span.start, c};
+            after = TextSpan{c + 1, span.end};
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseLong(const TextSpan &span, long &value)   // The whole span must be a whole number with an optional sign
+{
+    const char *c = span.start;
+    bool negative = c < span.end && *c == '-';
+    if (c < span.end && (*c == '-' || *c == '+')) c++;
+    if (c == span.end) return false;
+    long result = 0;
+    for (; c < span.end; c++) {
+        if (*c < '0' || *c > '9' || result > 100000000L) return false;
+        result = result * 10 + *c - '0';
+    }
+    value = negative ? -result : result;
+    return true;
+}
+
+bool parseFixed(const TextSpan &span, int decimals, long &value)   // "1.5" with 3 decimals is 1500 - extra digits are dropped
+{
+    TextSpan whole = span, fraction = TextSpan{span.end, span.end};
+    splitAt(span, '.', whole, fraction);
+    long result = 0;
+    if (whole.start == whole.end || (whole.end - whole.start == 1 && (*whole.start == '-' || *whole.start == '+'))) {
+        if (fraction.start == fraction.end) return false;   // "." or "-" alone
+    }
+    else if (!parseLong(whole, result)) return false;
+    bool negative = whole.start < whole.end && *whole.start == '-';
+    for (int i = 0; i < decimals; i++) {
+        const char *c = fraction.start + i;
+        int digit = 0;
+        if (c < fraction.end) {
+            if (*c < '0' || *c > '9') return false;
+            digit = *c - '0';
+        }
+        result = result * 10 + (negative ? -digit : digit);
+    }
+    for (const char *c = fraction.start + decimals; c < fraction.end; c++) if (*c < '0' || *c > '9') return false;
+    value = result;
+    return true;
+}
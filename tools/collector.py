@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""Stand-in for the report collector - the direct path in src/Report-Transport.h.
+
+Listens for report datagrams, checks the frame and its CRC, acks each one and
+prints it. Each report carries the UTC hour its counts are for and one value is
+kept per device and hour - a report sent again because an ack was lost, or an
+hour sent early and again once it closed, replaces what is stored rather than
+adding to it. Python 3.7+, no dependencies.
+
+    python3 tools/collector.py --port 8631                          # then Config "transport=collector,collector=<this host>:8631"
+    python3 tools/collector.py --port 8631 --csv reports.csv --drop-rate 0.2 --error-rate 0.05
+    python3 tools/collector.py --probe 127.0.0.1:8631 --count 20   # send test reports and time the acks
+
+Frames are big endian:
+    report  C5 01 device[12] sequence[4] hour[4] time[4] hourly[2] daily[2] quarantine[2] battery temp resets alerts maxmin crc[2]
+    ack     C5 81 sequence[4] status crc[2]          status 0 is stored, anything else asks the device to retry
+"""
+
+import argparse
+import csv
+import random
+import socket
+import statistics
+import struct
+import sys
+import time
+
+FRAME_START = 0xC5
+REPORT = 0x01
+ACK = 0x81
+REPORT_FORMAT = ">BB12sIIIHHHBbBBB"                # Everything before the CRC
+REPORT_SIZE = struct.calcsize(REPORT_FORMAT) + 2
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT - matches transferCRC()."""
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) & 0xFFFF if crc & 0x8000 else (crc << 1) & 0xFFFF
+    return crc
+
+
+def with_crc(body):
+    return body + struct.pack(">H", crc16(body))
+
+
+def ack(sequence, status):
+    return with_crc(struct.pack(">BBIB", FRAME_START, ACK, sequence, status))
+
+
+def decode(datagram):
+    """The report as a dict - None if it is not a good report frame."""
+    if len(datagram) != REPORT_SIZE or crc16(datagram[:-2]) != struct.unpack(">H", datagram[-2:])[0]:
+        return None
+    start, kind, device, sequence, hour, stamp, hourly, daily, quarantine, battery, temp, resets, alerts, maxmin = \
+        struct.unpack(REPORT_FORMAT, datagram[:-2])
+    if start != FRAME_START or kind != REPORT:
+        return None
+    return {"device": device.hex(), "sequence": sequence, "hour": hour, "time": stamp, "hourly": hourly, "daily": daily,
+            "quarantine": quarantine, "battery": battery, "temp": temp, "resets": resets, "alerts": alerts, "maxmin": maxmin}
+
+
+def serve(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("", args.port))
+    writer = None
+    if args.csv:
+        output = open(args.csv, "a", newline="")
+        writer = csv.DictWriter(output, ["received", "device", "sequence", "hour", "time", "hourly", "daily", "quarantine",
+                                         "battery", "temp", "resets", "alerts", "maxmin"])
+        if output.tell() == 0:
+            writer.writeheader()
+    stored = {}                                  # (device, hour) -> (hourly, daily, quarantine) last stored
+    print("Collector listening on UDP %d" % args.port)
+    while True:
+        datagram, sender = sock.recvfrom(512)
+        report = decode(datagram)
+        if report is None:
+            print("%s: %d bytes - not a report frame" % (sender[0], len(datagram)))
+            continue
+        status = 1 if random.random() < args.error_rate else 0
+        key = (report["device"], report["hour"])
+        counts = (report["hourly"], report["daily"], report["quarantine"])
+        previous = stored.get(key)
+        repeat = " (repeat)" if previous == counts else " (update)" if previous else ""
+        if status == 0 and previous != counts:
+            stored[key] = counts
+            if writer:
+                writer.writerow(dict(report, received=int(time.time())))
+                output.flush()
+        print("%s %s #%d %s hourly %d daily %d held %d battery %d%% temp %dF%s%s" % (
+            sender[0], report["device"][-6:], report["sequence"],
+            time.strftime("%Y-%m-%d %H:00Z", time.gmtime(report["hour"] * 3600)), report["hourly"], report["daily"], report["quarantine"],
+            report["battery"],
+            report["temp"], repeat, " -> error" if status else ""))
+        if random.random() < args.drop_rate:
+            continue                             # Ack lost - the device sends the report again
+        if args.delay:
+            time.sleep(args.delay)
+        sock.sendto(ack(report["sequence"], status), sender)
+
+
+def probe(args):
+    host, port = args.probe.rsplit(":", 1)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(args.timeout)
+    times, lost = [], 0
+    hour = int(time.time()) // 3600
+    for sequence in range(1, args.count + 1):
+        body = struct.pack(REPORT_FORMAT, FRAME_START, REPORT, bytes(12), sequence, hour - args.count + sequence, int(time.time()),
+                           sequence, sequence * 2, 0, 80, 70, 0, 0, 1)
+        started = time.monotonic()
+        sock.sendto(with_crc(body), (host, int(port)))
+        try:
+            while True:
+                reply = sock.recv(64)
+                if reply == ack(sequence, 0) or reply == ack(sequence, 1):
+                    times.append((time.monotonic() - started) * 1000)
+                    break
+        except socket.timeout:
+            lost += 1
+    print("%d reports, %d acked, %d without an ack, %d bytes out and %d bytes in for each acked report" % (
+        args.count, len(times), lost, REPORT_SIZE, len(ack(0, 0))))
+    if times:
+        print("Ack time: median %.1f ms, max %.1f ms" % (statistics.median(times), max(times)))
+    return 0 if times else 1
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--port", type=int, default=8631, help="UDP port to listen on")
+    parser.add_argument("--csv", help="append stored reports to this file")
+    parser.add_argument("--drop-rate", type=float, default=0.0, help="acks not sent - the device resends")
+    parser.add_argument("--error-rate", type=float, default=0.0, help="reports answered with an error status")
+    parser.add_argument("--delay", type=float, default=0.0, help="seconds before each ack")
+    parser.add_argument("--probe", metavar="HOST:PORT", help="send test reports to a collector instead of being one")
+    parser.add_argument("--count", type=int, default=10, help="reports to send with --probe")
+    parser.add_argument("--timeout", type=float, default=2.0, help="seconds to wait for each ack with --probe")
+    args = parser.parse_args()
+    try:
+        sys.exit(probe(args) if args.probe else serve(args))
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,311 @@
+#!/usr/bin/env python3
+"""Fleet load simulator for the hourly Ubidots-Car-Hook report.
+
+Runs many simulated devices that follow the firmware's reporting logic
+(REPORTING_STATE -> RESP_WAIT_STATE, and the retry controller's backoff
+and escalation when a report fails) against a local HTTP server standing in for the Particle webhook and Ubidots.
+Time is compressed - with the default --time-scale of 120 a simulated
+hour takes 30 real seconds - and every delay below is in simulated seconds.
+
+    python3 tools/fleet-sim.py --devices 300 --hours 3 --error-rate 0.05 --latency 2 --capacity 20
+
+At the end it prints fleet-wide throughput, how many requests, reconnects,
+modem cycles and resets each hour generated (retry storms), response times and how many counts
+were lost or double counted compared with what the devices really saw. Like the firmware, each
+device keeps its closed hours until a report of them is acked and the backend keeps one value per
+device and hour, so a report sent again after a lost response replaces rather than adds.
+"""
+
+import argparse
+import asyncio
+import hashlib
+import json
+import random
+import statistics
+import time
+from collections import Counter
+
+# Firmware constants - see Cellular-Pressure.ino
+WEBHOOK_WAIT = 45        # webhookWait
+# Retry-Controller.h
+RETRY_BASE = 60          # retryBaseSeconds
+RETRY_MAX = 3600         # retryMaxSeconds
+RETRY_ATTEMPTS = [2, 2, 2, 1]    # retryAttemptsPerAction - publish, reconnect, modem, reset
+PUBLISH, RECONNECT, MODEM, RESET = range(4)
+MODEM_CYCLE = 10         # Cellular.off() / on() before the connect
+RESET_BOOT = 10          # System.reset() and setup() before the connect
+
+
+class Clock:
+    """Maps simulated seconds onto real time."""
+
+    def __init__(self, scale):
+        self.scale = scale
+        self.start = time.monotonic()
+
+    def now(self):
+        return (time.monotonic() - self.start) * self.scale
+
+    async def sleep(self, seconds):
+        await asyncio.sleep(max(seconds, 0) / self.scale)
+
+
+class Stats:
+    def __init__(self):
+        self.requests = Counter()        # by simulated hour
+        self.reconnects = Counter()      # by simulated hour
+        self.modem_cycles = Counter()    # by simulated hour
+        self.resets = Counter()          # by simulated hour
+        self.capped = 0                  # attempts put off to the next day by the radio cap
+        self.status = Counter()
+        self.timeouts = 0
+        self.confirm_times = []          # publish to confirmed response
+        self.stored = {}                 # (device, hour) -> hourly - the backend's one value per device and hour
+        self.generated = 0               # counts the devices really saw
+        self.pending = 0                 # counts still on the devices at the end and not yet stored
+        self.resent = 0                  # hours stored but still waiting for an ack at the end
+        self.max_concurrent = 0
+
+
+class Backend:
+    """Stand-in for the webhook and Ubidots - configurable latency, errors and capacity."""
+
+    def __init__(self, args, clock, stats):
+        self.args = args
+        self.clock = clock
+        self.stats = stats
+        self.slots = asyncio.Semaphore(args.capacity)
+        self.active = 0
+
+    async def handle(self, reader, writer):
+        try:
+            request = await reader.readuntil(b"\r\n\r\n")
+            device = request.split(b" ")[1].rsplit(b"/", 1)[-1].decode()
+            length = 0
+            for line in request.decode().split("\r\n"):
+                if line.lower().startswith("content-length:"):
+                    length = int(line.split(":", 1)[1])
+            body = json.loads(await reader.readexactly(length))
+            self.active += 1
+            self.stats.max_concurrent = max(self.stats.max_concurrent, self.active)
+            async with self.slots:                       # Requests queue once the backend is saturated
+                await self.clock.sleep(random.uniform(0.5, 1.5) * self.args.latency)
+            self.active -= 1
+            if random.random() < self.args.error_rate:
+                status = random.choice(self.args.error_codes)
+            else:
+                status = 200
+                self.stats.stored[(device, body["hour"])] = body["hourly"]   # Stored even if the response never makes it back
+            if random.random() < self.args.drop_rate:
+                return                                   # Response lost on the way back
+            reply = ("%d %d %d" % (status, body["seq"], body["hour"])).encode()   # responseTemplate echoes which report it answers
+            writer.write(b"HTTP/1.1 %d X\r\nContent-Length: %d\r\n\r\n%s" % (status, len(reply), reply))
+            await writer.drain()
+        except (asyncio.IncompleteReadError, asyncio.CancelledError, ConnectionError, ValueError):
+            pass                                         # Cancelled is a device giving up or the run ending
+        finally:
+            writer.close()
+
+
+class Device:
+    """One unit running the reporting part of loop()."""
+
+    def __init__(self, number, args, clock, stats):
+        self.id = "%024x" % number
+        self.args = args
+        self.clock = clock
+        self.stats = stats
+        digest = hashlib.sha1(self.id.encode()).digest()
+        self.offset = int.from_bytes(digest[:4], "big") % args.jitter_window if args.jitter_window else 0
+        self.hourly = 0                                  # hourlyPersonCount - survives resets as it is in FRAM
+        self.sequence = 0                                # reportSequence - starts again after a reset
+        self.hour = 0                                    # The hour it belongs to
+        self.buckets = []                                # Closed hours waiting for an ack - Hour-Buckets.h
+        self.connected = False
+        self.failures = 0                                # RetryState - also in FRAM
+        self.action = PUBLISH
+        self.attempts = 0
+        self.radio_day = 0
+        self.radio_seconds = 0
+        self.next_at = 0
+
+    def add_counts(self, hours):
+        cars = sum(1 for _ in range(int(self.args.cars_per_hour * 2 * hours)) if random.random() < 0.5)
+        self.hourly += cars
+        self.stats.generated += cars
+
+    def count_to(self, counted_to, now):
+        """Counts up to now - closeHour() at each top of the hour on the way."""
+        while (self.hour + 1) * 3600 <= now:
+            self.add_counts(((self.hour + 1) * 3600 - counted_to) / 3600)
+            counted_to = (self.hour + 1) * 3600
+            self.buckets.append((self.hour, self.hourly))
+            self.hour, self.hourly = self.hour + 1, 0
+        self.add_counts((now - counted_to) / 3600)
+        return now
+
+    async def connect(self):
+        if not self.connected:
+            await self.clock.sleep(random.uniform(*self.args.connect_time))
+            self.connected = True
+
+    async def publish(self, payload):
+        """Particle.publish() through the cloud to the webhook - returns the status code or None on timeout."""
+        await self.clock.sleep(self.args.cloud_latency)
+        hour = int(self.clock.now() // 3600)
+        self.stats.requests[hour] += 1
+        body = json.dumps(payload).encode()
+        try:
+            reader, writer = await asyncio.open_connection("127.0.0.1", self.args.port)
+            writer.write(b"POST /api/v1.6/devices/%s HTTP/1.1\r\nContent-Length: %d\r\n\r\n%s" % (self.id.encode(), len(body), body))
+            await writer.drain()
+            reply = await reader.read()
+            writer.close()
+            if not reply:
+                return None
+            status, seq, hour = (int(field) for field in reply.split(b"\r\n\r\n", 1)[1].split())
+            return status if (seq, hour) == (payload["seq"], payload["hour"]) else None   # UbidotsHandler ignores another report's answer
+        except (ConnectionError, ValueError, IndexError):
+            return None
+
+    async def report(self, end):
+        """REPORTING_STATE and RESP_WAIT_STATE - returns True once the oldest closed hour is confirmed."""
+        await self.connect()
+        hour, sent = self.buckets[0]
+        started = self.clock.now()
+        self.sequence += 1
+        task = asyncio.ensure_future(self.publish({"seq": self.sequence, "hour": hour, "hourly": sent, "battery": 80}))
+        deadline = started + WEBHOOK_WAIT
+        while self.clock.now() < min(deadline, end):
+            await self.clock.sleep(1)
+            if task.done() and task.result() in (200, 201):
+                self.stats.status[task.result()] += 1
+                self.stats.confirm_times.append(self.clock.now() - started)
+                self.buckets.pop(0)                      # hourAcked()
+                return True
+            if task.done() and task.result() is not None:
+                break                                    # An error code ends the wait - no need to wait out webhookWait
+        if task.done() and task.result() is not None:
+            self.stats.status[task.result()] += 1
+        else:
+            self.stats.timeouts += 1
+        task.cancel()
+        return False
+
+    async def escalate(self):
+        """retryEscalate() - the step on the ladder taken before a retry."""
+        hour = int(self.clock.now() // 3600)
+        if self.action == RECONNECT:
+            self.stats.reconnects[hour] += 1
+            self.connected = False
+        elif self.action == MODEM:
+            self.stats.modem_cycles[hour] += 1
+            self.connected = False
+            await self.clock.sleep(MODEM_CYCLE)
+        elif self.action == RESET:
+            self.stats.resets[hour] += 1
+            self.connected = False
+            self.action, self.attempts = PUBLISH, 0      # retryResetting()
+            self.sequence = 0
+            await self.clock.sleep(RESET_BOOT)
+
+    def failed(self, radio_seconds, ceiling):
+        """retryFailed() - back off with jitter and step up the ladder no higher than ceiling."""
+        now = self.clock.now()
+        if self.radio_day != int(now // 86400):
+            self.radio_day, self.radio_seconds = int(now // 86400), 0
+        self.radio_seconds += radio_seconds
+        self.failures += 1
+        self.attempts += 1
+        if self.attempts >= RETRY_ATTEMPTS[self.action] and self.action < ceiling:
+            self.action, self.attempts = self.action + 1, 0
+        if self.action > ceiling:
+            self.action, self.attempts = ceiling, 0
+        self.attempts = min(self.attempts, RETRY_ATTEMPTS[self.action])
+        backoff = min(RETRY_BASE << min(self.failures - 1, 6), RETRY_MAX)
+        self.next_at = now + backoff / 2 + random.uniform(0, backoff / 2)
+        if self.radio_seconds >= self.args.retry_cap * 60:
+            self.stats.capped += 1
+            self.next_at = max(self.next_at, (now // 86400 + 1) * 86400 + random.uniform(0, RETRY_MAX))
+
+    async def run(self, hours):
+        end = hours * 3600
+        next_report = 3600 + self.offset                 # Time.hour() changes - plus any per-device offset
+        counted_to = 0
+        while next_report < end:
+            await self.clock.sleep(next_report - self.clock.now())
+            counted_to = self.count_to(counted_to, self.clock.now())
+            if not self.buckets:
+                next_report = (self.clock.now() // 3600 + 1) * 3600 + self.offset
+                continue
+            if self.failures:
+                await self.escalate()
+            started = self.clock.now()
+            if await self.report(end):
+                self.failures, self.action, self.attempts = 0, PUBLISH, 0    # retrySucceeded()
+                next_report = self.clock.now() if self.buckets else (self.clock.now() // 3600 + 1) * 3600 + self.offset
+            else:
+                self.failed(self.clock.now() - started, MODEM)   # The report went out - sending it again is safe, a reset won't help
+                next_report = self.next_at               # Counts keep coming in while we wait
+        self.count_to(counted_to, end)
+        for hour, hourly in self.buckets + [(self.hour, self.hourly)]:
+            if (self.id, hour) in self.stats.stored:     # Stored but the ack never came - it goes again under the same key
+                self.stats.resent += 1
+                self.stats.pending += hourly - self.stats.stored[(self.id, hour)]
+            else:
+                self.stats.pending += hourly
+
+
+def summarize(args, stats, elapsed):
+    print("Devices %d, %d simulated hours in %.1f real seconds" % (args.devices, args.hours, elapsed))
+    print("Backend: capacity %d, latency %.1fs, error rate %.0f%%, drop rate %.0f%%, peak concurrent %d" % (
+        args.capacity, args.latency, args.error_rate * 100, args.drop_rate * 100, stats.max_concurrent))
+    print("Throughput: %d confirmed reports, %.1f per simulated minute" % (
+        len(stats.confirm_times), len(stats.confirm_times) / (args.hours * 60.0)))
+    if stats.confirm_times:
+        times = sorted(stats.confirm_times)
+        print("Publish to confirm: median %.1fs, 95th %.1fs, max %.1fs" % (
+            statistics.median(times), times[int(len(times) * 0.95)], times[-1]))
+    print("Responses: %s, timeouts %d" % (dict(stats.status), stats.timeouts))
+    print("Hour  requests  reconnects  modem-cycles  resets")
+    for hour in range(args.hours):
+        print("%4d  %8d  %10d  %12d  %6d" % (hour, stats.requests[hour], stats.reconnects[hour], stats.modem_cycles[hour], stats.resets[hour]))
+    if stats.capped:
+        print("Retries put off to the next day by the radio cap: %d" % stats.capped)
+    accepted = sum(stats.stored.values())
+    difference = stats.generated - accepted - stats.pending
+    print("Counts: %d seen, %d stored by the backend, %d still on devices" % (stats.generated, accepted, stats.pending))
+    if stats.resent:
+        print("Hours stored but not yet acked - sent again under the same hour: %d" % stats.resent)
+    print("        %d %s" % (abs(difference), "lost" if difference >= 0 else "double counted"))
+
+
+async def main(args):
+    clock = Clock(args.time_scale)
+    stats = Stats()
+    backend = Backend(args, clock, stats)
+    server = await asyncio.start_server(backend.handle, "127.0.0.1", args.port, backlog=args.devices)
+    devices = [Device(n, args, clock, stats) for n in range(args.devices)]
+    started = time.monotonic()
+    await asyncio.gather(*(device.run(args.hours) for device in devices))
+    server.close()
+    summarize(args, stats, time.monotonic() - started)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--devices", type=int, default=100)
+    parser.add_argument("--hours", type=int, default=3, help="simulated hours to run")
+    parser.add_argument("--time-scale", type=float, default=120, help="simulated seconds per real second")
+    parser.add_argument("--port", type=int, default=8765)
+    parser.add_argument("--cars-per-hour", type=float, default=40)
+    parser.add_argument("--connect-time", type=float, nargs=2, default=(5, 20), metavar=("MIN", "MAX"))
+    parser.add_argument("--cloud-latency", type=float, default=0.5, help="device to webhook hop")
+    parser.add_argument("--latency", type=float, default=1.0, help="backend processing time per request")
+    parser.add_argument("--capacity", type=int, default=50, help="requests the backend works on at once")
+    parser.add_argument("--error-rate", type=float, default=0.0)
+    parser.add_argument("--error-codes", type=int, nargs="+", default=[500, 502, 429])
+    parser.add_argument("--drop-rate", type=float, default=0.0, help="responses lost after the backend stored the data")
+    parser.add_argument("--jitter-window", type=int, default=0, help="spread reports over this many seconds after the hour")
+    parser.add_argument("--retry-cap", type=float, default=30, help="minutes of radio a day for failed reports (retrycap)")
+    asyncio.run(main(parser.parse_args()))
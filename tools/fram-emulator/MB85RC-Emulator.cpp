@@ -0,0 +1,95 @@
+#include "MB85RC-Emulator.h"
+
+const uint8_t deviceIdAddress = 0xF8 >> 1;          // Reserved address for the device ID command
+const uint16_t fujitsuID = 0x00A;
+
+std::vector<MB85RCEmulator *> emulatedBus;
+BusCounters busCounters;
+TwoWire Wire;
+CloudClass Particle;
+TimeClass Time;
+
+bool MB85RCEmulator::transmit(uint8_t device, const uint8_t *data, size_t count)
+{
+    if (!powered()) return false;
+    if (device == deviceIdAddress) {                // Followed by our address and a repeated START to read the ID
+        idRequested = count == 1 && data[0] >> 1 == address;
+        return idRequested;
+    }
+    if (!answers(device)) return false;
+    if (count < 2) return true;                     // Address not complete - the pointer is unchanged
+    pointer = ((size_t)(device - address) << 16 | data[0] << 8 | data[1]) % size;
+    for (size_t i = 2; i < count; i++) {
+        if (writeBudget == 0) return false;         // Power lost part way through
+        memory[pointer] = data[i];
+        pointer = (pointer + 1) % size;
+        if (writeBudget > 0) writeBudget--;
+    }
+    return true;
+}
+
+size_t MB85RCEmulator::receive(uint8_t device, uint8_t *data, size_t count)
+{
+    if (!powered()) return 0;
+    if (device == deviceIdAddress && idRequested) {
+        uint8_t id[3] = {(uint8_t)(fujitsuID >> 4), (uint8_t)(((fujitsuID & 0xF) << 4) | (productID >> 8)), (uint8_t)(productID & 0xFF)};
+        idRequested = false;
+        for (size_t i = 0; i < count; i++) data[i] = i < 3 ? id[i] : 0xFF;
+        return count;
+    }
+    if (!answers(device)) return 0;
+    for (size_t i = 0; i < count; i++) {
+        data[i] = memory[pointer];
+        pointer = (pointer + 1) % size;
+    }
+    return count;
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+    txAddress = address;
+    txLength = 0;
+}
+
+size_t TwoWire::write(uint8_t value)
+{
+    if (txLength >= I2C_BUFFER_LENGTH) {
+        overflows++;
+        return 0;
+    }
+    txBuffer[txLength++] = value;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *values, size_t count)
+{
+    size_t written = 0;
+    while (written < count && write(values[written])) written++;
+    overflows += count - written - (written < count ? 1 : 0);   // write() counted the first one dropped
+    return written;
+}
+
+uint8_t TwoWire::endTransmission(bool stop)
+{
+    busCounters.transactions++;
+    busCounters.bytesOut += txLength;
+    busCounters.bits += 1 + 9 * (1 + txLength) + (stop ? 1 : 0);
+    bool acked = false;
+    for (MB85RCEmulator *chip : emulatedBus) acked |= chip->transmit(txAddress, txBuffer, txLength);
+    txLength = 0;
+    return acked ? 0 : 2;                           // 2 is an address NACK as in Wire
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, uint8_t stop)
+{
+    quantity = min(quantity, (uint8_t)I2C_BUFFER_LENGTH);
+    busCounters.transactions++;
+    busCounters.bits += 1 + 9 * (1 + quantity) + (stop ? 1 : 0);
+    rxLength = rxIndex = 0;
+    for (MB85RCEmulator *chip : emulatedBus) {
+        size_t received = chip->receive(address, rxBuffer, quantity);
+        if (received) rxLength = received;
+    }
+    busCounters.bytesIn += rxLength;
+    return rxLength;
+}
@@ -0,0 +1,49 @@
+// MB85RC FRAM emulator - a chip on the emulated Wire bus with bus cost accounting
+// Models the memory array, the auto-incrementing address pointer (wraps at the end of the array), the device ID
+// command and a power loss after a set number of stored bytes. Parts over 64KB (the MB85RC1M is size 131072 and
+// product 0x758) take address bit 16 and up from the I2C address, so they answer at more than one address. Every transaction on the bus is counted so the cost of
+// a code path can be given in transactions, bytes and bus time at 100kHz or 400kHz.
+
+#ifndef MB85RC_EMULATOR_H
+#define MB85RC_EMULATOR_H
+
+#include <vector>
+#include "Particle.h"
+
+struct BusCounters {
+    unsigned long transactions = 0;                 // One per START - addressed writes and reads
+    unsigned long bytesOut = 0;                     // Master to chip - memory addresses and data, not the device address
+    unsigned long bytesIn = 0;                      // Chip to master
+    unsigned long bits = 0;                         // START, 9 bits per byte including the device address and ACK, STOP
+
+    double busMicros(unsigned long hz) const { return bits * 1e6 / hz; }
+};
+
+class MB85RCEmulator {
+public:
+    MB85RCEmulator(size_t size = 32768, uint8_t address = 0x50, uint16_t productID = 0x510)
+        : memory(size, 0), size(size), address(address), productID(productID) {}
+
+    bool transmit(uint8_t device, const uint8_t *data, size_t count);   // Write transaction - false is a NACK
+    size_t receive(uint8_t device, uint8_t *data, size_t count);        // Read transaction - 0 is a NACK
+
+    void powerLossAfter(long bytes) { writeBudget = bytes; }           // -1 for never - memory keeps what was stored
+    bool powered() const { return writeBudget != 0; }
+
+    std::vector<uint8_t> memory;
+    size_t size;
+
+private:
+    bool answers(uint8_t device) const { return device >= address && device < address + (size > 0x10000 ? size >> 16 : 1); }
+
+    uint8_t address;
+    uint16_t productID;                             // Density nibble and product code - 0x510 is the MB85RC256V
+    size_t pointer = 0;
+    bool idRequested = false;
+    long writeBudget = -1;
+};
+
+extern std::vector<MB85RCEmulator *> emulatedBus;  // Chips Wire talks to
+extern BusCounters busCounters;
+
+#endif
@@ -0,0 +1,73 @@
+// Host stand-in for the parts of Particle.h used by the FRAM driver, FRAM-Library-Extensions.h, Hour-Buckets.h,
+// Daily-Rollup.h and Burst-Detector.h. Wire is backed by the emulated chips in MB85RC-Emulator.h, Time is UTC
+
+#ifndef FRAM_EMULATOR_PARTICLE_H
+#define FRAM_EMULATOR_PARTICLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+template<class T> T min(T a, T b) { return a < b ? a : b; }
+template<class T> T max(T a, T b) { return a > b ? a : b; }
+template<class T> T constrain(T x, T low, T high) { return x < low ? low : x > high ? high : x; }
+
+#define CLOCK_SPEED_100KHZ  100000
+#define CLOCK_SPEED_400KHZ  400000
+#define I2C_BUFFER_LENGTH   32
+
+class TwoWire {                                     // Same buffering as Device OS - 32 bytes each way
+public:
+    void begin() {}
+    void setSpeed(uint32_t hz) { speed = hz; }
+    void beginTransmission(uint8_t address);
+    void beginTransmission(int address) { beginTransmission((uint8_t)address); }
+    size_t write(uint8_t value);
+    size_t write(const uint8_t *values, size_t count);
+    uint8_t endTransmission(bool stop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t stop = true);
+    uint8_t requestFrom(int address, int quantity) { return requestFrom((uint8_t)address, (uint8_t)quantity); }
+    int available() { return rxLength - rxIndex; }
+    int read() { return rxIndex < rxLength ? rxBuffer[rxIndex++] : -1; }
+
+    uint32_t speed = CLOCK_SPEED_100KHZ;
+    unsigned long overflows = 0;                    // Bytes dropped because a transmission did not fit the buffer
+
+private:
+    uint8_t txAddress = 0;
+    uint8_t txBuffer[I2C_BUFFER_LENGTH];
+    size_t txLength = 0;
+    uint8_t rxBuffer[I2C_BUFFER_LENGTH];
+    size_t rxLength = 0;
+    size_t rxIndex = 0;
+};
+extern TwoWire Wire;
+
+struct CloudClass {                                 // ResetFRAM() publishes progress - never connected here
+    bool connected() { return false; }
+    bool publish(const char *, const char *) { return true; }
+};
+extern CloudClass Particle;
+
+struct TimeClass {                                  // The time is whatever the report sets - zone 0
+    time_t now() { return current; }
+    float zone() { return 0; }
+    int hour(time_t t) { return field(t)->tm_hour; }
+    int minute(time_t t) { return field(t)->tm_min; }
+    int day(time_t t) { return field(t)->tm_mday; }
+    int month(time_t t) { return field(t)->tm_mon + 1; }
+    int year(time_t t) { return field(t)->tm_year + 1900; }
+    time_t current = 1700000000;
+
+private:
+    static struct tm *field(time_t t) { return gmtime(&t); }
+};
+extern TimeClass Time;
+
+#define PROFILE_PHASE(phase)
+
+#endif
@@ -0,0 +1,228 @@
+// FRAM bus cost report - runs the real FRAM driver and FRAM-Library-Extensions.h against an emulated MB85RC256V
+//
+//   g++ -std=c++11 -Itools/fram-emulator -Isrc tools/fram-emulator/*.cpp src/Adafruit_FRAM_I2C.cpp -o fram-bus-report
+//   ./fram-bus-report
+//
+// Prints the I2C transactions, bytes and bus time at 100kHz and 400kHz for the FRAM work done by recordCount(),
+// setup() and ResetFRAM(), then cuts the power at every byte of a recordCount() update and of a closeHour() to show
+// which torn states a reset can find, and checks a two chip space. The map is the sketch's own src/FRAM-Map.h and the
+// burst detector, daily rollup and hour ring are the sketch's own code. recordCount() is run in its costliest case -
+// the first count of a minute after a busy one, so the burst bucket is written, and a new busiest minute with a gap
+// to record. The order of the writes around them, setup()'s config reads and going to sleep mirror the sketch - keep
+// them in step with it. Not covered: a quarantined count (fewer writes than a counted one), the adaptive debounce
+// saving what it learned and the retry and data meter state written after a report. Exits non-zero when an
+// operation goes over its bus budget, a power cut can close an hour twice or the Wire buffer overflows.
+
+#include <stdio.h>
+#include "MB85RC-Emulator.h"
+#include "Adafruit_FRAM_I2C.h"
+
+#include "FRAM-Map.h"                              // The sketch's own map - nothing to keep in step
+#include "Text-Buffer.h"
+#include "FRAM-Library-Extensions.h"
+#include "Burst-Detector.h"
+#include "Daily-Rollup.h"
+#include "Hour-Buckets.h"
+
+struct BusBudget {                                  // Most an operation may cost - a change that needs more has to say why
+    unsigned long transactions;
+    double micros;                                  // Bus time at 100kHz
+};
+const BusBudget recordCountBudget = {14, 6500};     // Every counted vehicle at its costliest - keeps the ISR to loop() gap short
+const BusBudget setupBudget = {160, 80000};         // Every wake from deep sleep goes through setup()
+const BusBudget sleepBudget = {12, 12000};          // Log spill and data meter save before deep sleep
+
+BusBudget resetBudget(unsigned long size)           // ResetFRAM() zeroes the whole space a Wire buffer at a time - it grows with the chips found
+{
+    unsigned long blocks = size / (MB85RC_WIRE_BUFFER - 2) + 1;
+    return {blocks + 32, blocks * 3300.0};          // About 3mSec a block at 100kHz - and the defaults written after
+}
+
+void costliestCount(time_t now)                     // RAM only - the next count starts a minute after a busy one, beats the busiest minute and has a gap
+{
+    burstMinuteStart = now - now % 60 - 60;
+    burstMinuteCount = burstThreshold = 3;
+    rollupToday.opened = now - 3600;
+    rollupToday.busiestMinuteCount = 0;
+    rollupLastArrival = now - 30;
+}
+
+void recordCountIO(int hourly, int daily, time_t now)   // The FRAM writes for one counted vehicle
+{
+    burstCount(now, 8);                             // Saves the last minute's bucket when this count starts a new one
+    FRAMwrite16(FRAM::currentHourlyCountAddr, hourly);
+    FRAMwrite16(FRAM::currentDailyCountAddr, daily);
+    FRAMwrite32(FRAM::currentCountsTimeAddr, now);
+    rollupRecord(now, burstMinuteCount);            // The hour, the busiest minute and the gap bucket
+}
+
+void napCountIO(time_t now)                         // The FRAM writes for one vehicle counted in a counting nap
+{
+    burstCount(now, 8);
+    FRAMwrite16(FRAM::napPulsesAddr, 3);
+    rollupRecord(now, burstMinuteCount);
+}
+
+void sleepIO()                                      // SLEEPING_STATE before deep sleep - logSpill() of a few records and usageSave()
+{
+    uint8_t record[10] = {0}, meter[45] = {0};
+    for (int i = 0; i < 4; i++) FRAMwriteBlock(FRAM::logRecordsAddr + i * sizeof(record), record, sizeof(record));
+    FRAMwrite16(FRAM::logHeadAddr, 0);
+    FRAMwrite16(FRAM::logCountAddr, 4);
+    FRAMwriteBlock(FRAM::usageMeterAddr, meter, sizeof(meter));
+}
+
+void setupIO()                                      // The FRAM reads in a normal setup() - no reset or new day
+{
+    uint8_t block[120];
+    fram.begin();
+    FRAMread8(FRAM::versionAddr);
+    FRAMread8(FRAM::alertsCountAddr);
+    FRAMread8(FRAM::resetCountAddr);
+    FRAMread8(FRAM::debounceAddr);
+    FRAMread8(FRAM::debounceAutoAddr);              // debounceBegin()
+    FRAMread16(FRAM::learnedDebounceAddr);
+    FRAMread8(FRAM::debounceConfidenceAddr);
+    FRAMreadBlock(FRAM::pulseHistogramsAddr, block, 96);
+    FRAMread8(FRAM::openTimeAddr);
+    FRAMread8(FRAM::closeTimeAddr);
+    FRAMreadBlock(FRAM::scheduleAddr, block, 48);
+    FRAMread8(FRAM::timeZoneAddr);
+    FRAMread8(FRAM::maxMinLimitAddr);
+    FRAMread8(FRAM::jitterWindowAddr);
+    FRAMread8(FRAM::minSignalAddr);
+    FRAMread8(FRAM::maxStaleAddr);
+    FRAMread8(FRAM::napCountingAddr);
+    FRAMread8(FRAM::transportAddr);
+    FRAMreadBlock(FRAM::collectorHostAddr, block, 4);
+    FRAMread16(FRAM::collectorPortAddr);
+    FRAMread8(FRAM::retryCapAddr);
+    FRAMread16(FRAM::usageBudgetAddr);
+    FRAMread8(FRAM::controlRegisterAddr);
+    FRAMread16(FRAM::logHeadAddr);                  // logBegin()
+    FRAMread16(FRAM::logCountAddr);
+    rollupBegin();
+    FRAMreadBlock(FRAM::retryStateAddr, block, 11);     // retryBegin()
+    FRAMreadBlock(FRAM::usageMeterAddr, block, 45);     // usageBegin()
+    burstBegin();
+    hourBegin();
+    FRAMread32(FRAM::currentCountsTimeAddr);
+    FRAMread16(FRAM::currentDailyCountAddr);
+    FRAMread16(FRAM::currentHourlyCountAddr);
+    FRAMread16(FRAM::hourlyQuarantineAddr);
+    FRAMread16(FRAM::dailyQuarantineAddr);
+    FRAMread16(FRAM::napPulsesAddr);
+}
+
+void closeHourIO(uint32_t hour, int hourly)        // closeHour() - the hour goes in the ring, then its counts are zeroed
+{
+    hourPush(hour, hourly, 0, hourly);
+    FRAMwrite16(FRAM::currentHourlyCountAddr, 0);
+    FRAMwrite16(FRAM::hourlyQuarantineAddr, 0);
+}
+
+void setupHourIO(uint32_t now)                      // What setup() does with the saved counts - hour 'now' is the current one
+{
+    hourBegin();
+    uint32_t lastCount = FRAMread32(FRAM::currentCountsTimeAddr);
+    int hourly = FRAMread16(FRAM::currentHourlyCountAddr);
+    if (hourClosed(lastCount)) {
+        FRAMwrite16(FRAM::currentHourlyCountAddr, 0);
+        FRAMwrite16(FRAM::hourlyQuarantineAddr, 0);
+    }
+    else if (lastCount / 3600 != now) closeHourIO(lastCount / 3600, hourly);
+}
+
+bool overBudget = false;
+
+void report(const char *name, void (*operation)(), const BusBudget *budget = nullptr)
+{
+    busCounters = BusCounters();
+    operation();
+    double micros = busCounters.busMicros(CLOCK_SPEED_100KHZ);
+    bool over = budget && (busCounters.transactions > budget->transactions || micros > budget->micros);
+    overBudget = overBudget || over;
+    printf("%-26s %8lu %9lu %9lu %11.0f %11.0f  %s\n", name, busCounters.transactions, busCounters.bytesOut,
+        busCounters.bytesIn, micros, busCounters.busMicros(CLOCK_SPEED_400KHZ), !budget ? "" : over ? "OVER BUDGET" : "ok");
+}
+
+int main()
+{
+    MB85RCEmulator chip;
+    emulatedBus.push_back(&chip);
+    fram.begin();
+    uint16_t manufacturer, product;
+    fram.getDeviceID(&manufacturer, &product);
+    printf("Emulated chip: manufacturer 0x%03X product 0x%03X, %zu bytes\n\n", manufacturer, product, chip.size);
+
+    rollupOpen(Time.now());                         // A day open - as setup() finds it every time but the first
+    printf("%-26s %8s %9s %9s %11s %11s  %s\n", "Operation", "Transact", "Bytes out", "Bytes in", "100kHz us", "400kHz us", "Budget");
+    report("recordCount()", [] { costliestCount(Time.now()); recordCountIO(6, 21, Time.now()); }, &recordCountBudget);
+    report("Counting nap vehicle", [] { costliestCount(Time.now()); napCountIO(Time.now()); });
+    report("setup()", setupIO, &setupBudget);
+    report("Going to sleep", sleepIO, &sleepBudget);
+    BusBudget reset = resetBudget(fram.size());
+    report("ResetFRAM()", ResetFRAM, &reset);
+    report("Burst minute learned", [] { burstLearn(17, 3); });
+    report("Hour closed", [] { hourClear(); hourLast = 0; closeHourIO(470000, 6); });
+    report("Data usage save", [] { uint8_t meter[45] = {0}; FRAMwriteBlock(FRAM::usageMeterAddr, meter, sizeof(meter)); });
+    report("Config block write", [] { uint8_t block[configBlockSize] = {0}; FRAMwriteBlock(FRAM::debounceAddr, block, sizeof(block)); });
+    report("Log spill (32 records)", [] { uint8_t records[320] = {0}; FRAMwriteBlock(FRAM::logRecordsAddr, records, sizeof(records)); });
+    report("FRAM dump (32 KB)", [] { static uint8_t image[32768]; FRAMreadBlock(0, image, sizeof(image)); });
+    if (Wire.overflows) printf("\nWire buffer overflows: %lu bytes dropped\n", Wire.overflows);
+
+    // Power loss during recordCount() - hourly 5 -> 6 and daily 20 -> 21 in a new minute, so the burst bucket goes first
+    printf("\nPower lost after N stored bytes of recordCount() (hourly 5 -> 6, daily 20 -> 21):\n");
+    for (long cut = 0; cut <= 20; cut++) {
+        recordCountIO(5, 20, 1699999000UL);
+        chip.powerLossAfter(cut);
+        recordCountIO(6, 21, 1700000000UL);
+        chip.powerLossAfter(-1);
+        int hourly = FRAMread16(FRAM::currentHourlyCountAddr);
+        int daily = FRAMread16(FRAM::currentDailyCountAddr);
+        unsigned long stamp = FRAMread32(FRAM::currentCountsTimeAddr);
+        bool consistent = (hourly == 5 && daily == 20) || (hourly == 6 && daily == 21);
+        printf("  N=%-2ld  hourly %3i  daily %3i  time %s  %s\n", cut, hourly, daily,
+            stamp == 1700000000UL ? "new" : stamp == 1699999000UL ? "old" : "torn", consistent ? "" : "<- counts disagree");
+    }
+
+    // Power loss during closeHour() - hour 470000 closing with 6 counts, then setup() in the next hour
+    printf("\nPower lost after N stored bytes of closeHour() (6 counts in hour 470000), then setup() an hour later:\n");
+    bool closeHourSafe = true;
+    for (long cut = 0; cut <= 20; cut++) {
+        hourClear();
+        hourLast = 469999;
+        hourSavePosition();
+        recordCountIO(6, 6, 470000UL * 3600 + 1800);
+        chip.powerLossAfter(cut);
+        closeHourIO(470000, 6);
+        chip.powerLossAfter(-1);
+        setupHourIO(470002);
+        HourBucket bucket;
+        int buckets = 0, count = -1;
+        for (int i = 0; hourPeek(i, bucket); i++) if (bucket.hour == 470000) buckets++, count = bucket.count;
+        bool good = buckets == 1 && count == 6 && FRAMread16(FRAM::currentHourlyCountAddr) == 0;
+        closeHourSafe = closeHourSafe && good;
+        printf("  N=%-2ld  buckets for the hour %i  count %2i  last %lu  %s\n", cut, buckets, count, (unsigned long)hourLast,
+            good ? "" : buckets > 1 ? "<- hour closed twice" : "<- hour lost");
+    }
+
+    // An MB85RC1M at 0x50 (it also answers at 0x51) and an MB85RC256V at 0x52 make one 160KB space
+    MB85RCEmulator big(131072, 0x50, 0x758), small(32768, 0x52, 0x510);
+    emulatedBus.clear();
+    emulatedBus.push_back(&big);
+    emulatedBus.push_back(&small);
+    fram.begin();
+    printf("\nMB85RC1M + MB85RC256V: %u chips, %lu bytes\n", fram.chips(), (unsigned long)fram.size());
+    uint8_t pattern[100], check[100];
+    for (int i = 0; i < 100; i++) pattern[i] = i + 1;
+    for (uint32_t address : {0xFFCEUL, 0x1FFCEUL}) {    // Across the 64KB page and across the two chips
+        FRAMwriteBlock(address, pattern, sizeof(pattern));
+        FRAMreadBlock(address, check, sizeof(check));
+        printf("  100 bytes at 0x%05lX %s\n", (unsigned long)address, memcmp(pattern, check, sizeof(check)) ? "DO NOT read back" : "read back");
+    }
+    reset = resetBudget(fram.size());
+    report("ResetFRAM() 160KB", ResetFRAM, &reset);
+    if (overBudget) printf("\nAn operation is over its bus budget\n");
+    return Wire.overflows || !closeHourSafe || overBudget ? 1 : 0;
+}
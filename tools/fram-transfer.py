@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""Dump or restore a unit's FRAM over USB serial.
+
+Talks to the command handler in src/FRAM-Serial-Transfer.h. Needs pyserial.
+
+    python3 tools/fram-transfer.py /dev/ttyACM0 info
+    python3 tools/fram-transfer.py /dev/ttyACM0 dump unit-42.bin                  # whole FRAM
+    python3 tools/fram-transfer.py /dev/ttyACM0 dump log.bin --region logrecords
+    python3 tools/fram-transfer.py /dev/ttyACM0 restore unit-42.bin
+    python3 tools/fram-transfer.py /dev/ttyACM0 restore part.bin --start 0x14
+
+Dumps are raw images of the range read. A restore writes the file starting at
+--start (0 by default), checks each frame as it is written and compares the
+device's read back CRC with the file before reporting success. Reset the unit
+afterwards so it loads the restored values.
+"""
+
+import argparse
+import sys
+
+import serial
+
+FRAME_START = 0xA5
+FRAME_DATA = 64          # transferFrameData
+RETRIES = 3              # Resends of a NAKed frame before giving up
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT - matches transferCRC()."""
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) & 0xFFFF if crc & 0x8000 else (crc << 1) & 0xFFFF
+    return crc
+
+
+def frame(address, data):
+    header = bytes([FRAME_START, (address >> 16) & 0xFF, (address >> 8) & 0xFF, address & 0xFF, len(data)])
+    crc = crc16(header + data)
+    return header + data + bytes([crc >> 8, crc & 0xFF])
+
+
+def reply(port, prefix):
+    """Next text line starting with prefix - other output from the firmware is skipped."""
+    while True:
+        line = port.readline().decode(errors="replace").strip()
+        if not line:
+            sys.exit("No reply from the device")
+        if line.startswith(("ERR", "FAIL")):
+            sys.exit("Device: " + line)
+        if line.startswith(prefix):
+            return line.split()[1:]
+
+
+def read_exact(port, count):
+    data = port.read(count)
+    if len(data) != count:
+        sys.exit("Dump stopped after %d of %d bytes" % (len(data), count))
+    return data
+
+
+def dump(port, args):
+    if args.region or args.length is None:
+        command = "D %s" % (args.region or "all")                # The device knows how much FRAM it has
+    else:
+        command = "D %d %d" % (args.start, args.length)
+    port.write((command + "\n").encode())
+    start, length = (int(value) for value in reply(port, "DUMP"))
+    image = bytearray()
+    while len(image) < length:
+        header = read_exact(port, 5)
+        address = (header[1] << 16) | (header[2] << 8) | header[3]
+        data = read_exact(port, header[4])
+        check = read_exact(port, 2)
+        if header[0] != FRAME_START or address != start + len(image) or crc16(header + data) != (check[0] << 8) | check[1]:
+            sys.exit("Bad frame at 0x%04X - dump again" % address)
+        image += data
+    expected = int(reply(port, "END")[0], 16)
+    if crc16(image) != expected:
+        sys.exit("Image CRC mismatch - dump again")
+    with open(args.file, "wb") as output:
+        output.write(image)
+    print("Read %d bytes from 0x%04X into %s (CRC %04X)" % (length, start, args.file, expected))
+
+
+def restore(port, args):
+    with open(args.file, "rb") as source:
+        image = source.read()
+    port.write(("R %d %d\n" % (args.start, len(image))).encode())
+    reply(port, "READY")
+    for offset in range(0, len(image), FRAME_DATA):
+        address = args.start + offset
+        for _ in range(RETRIES):
+            port.write(frame(address, image[offset:offset + FRAME_DATA]))
+            line = port.readline().decode(errors="replace").split()
+            if line and line[0] == "ACK":
+                break
+            if not line or line[0] != "NAK":
+                sys.exit("Restore stopped at 0x%04X: %s" % (address, " ".join(line) or "no reply"))
+        else:
+            sys.exit("Frame at 0x%04X keeps failing" % address)
+    device_crc = int(reply(port, "DONE")[0], 16)
+    if device_crc != crc16(image):
+        sys.exit("Read back CRC %04X does not match the file (%04X)" % (device_crc, crc16(image)))
+    print("Wrote and verified %d bytes at 0x%04X - reset the unit to load them" % (len(image), args.start))
+
+
+def info(port, args):
+    port.write(b"I\n")
+    size, version, chips = reply(port, "INFO")
+    print("FRAM %s bytes on %s chip(s), memory map version %s" % (size, chips, version))
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("port", help="USB serial port of the unit")
+    parser.add_argument("action", choices=["info", "dump", "restore"])
+    parser.add_argument("file", nargs="?", help="image to write (dump) or read (restore)")
+    parser.add_argument("--region", choices=["all", "config", "schedule", "log", "logrecords"], help="named region to dump")
+    parser.add_argument("--start", type=lambda value: int(value, 0), default=0)
+    parser.add_argument("--length", type=lambda value: int(value, 0), help="bytes to dump from --start - all of the FRAM if not given")
+    parser.add_argument("--timeout", type=float, default=5, help="seconds to wait for the device")
+    args = parser.parse_args()
+    if args.action != "info" and not args.file:
+        parser.error("a file is needed to dump or restore")
+    with serial.Serial(args.port, 115200, timeout=args.timeout) as connection:
+        connection.reset_input_buffer()
+        {"info": info, "dump": dump, "restore": restore}[args.action](connection, args)